@@ -1,30 +1,23 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/time.h>
 #include <omp.h> // OpenMP header
+#include "bench.h"
+#include "grid_alloc.h"
+#include "perf_region.h"
+#include "ws_sched.h"
 
 #define FINALIZE "\
 ffmpeg -y -start_number 0 -i out%d.pgm output.gif\n\
 rm *pgm\n\
 "
 
-static int ** allocate_array(int N) {
-    int ** array;
-    int i, j;
-    array = malloc(N * sizeof(int*));
-    for (i = 0; i < N ; i++)
-        array[i] = malloc(N * sizeof(int));
-    for (i = 0; i < N ; i++)
-        for (j = 0; j < N ; j++)
-            array[i][j] = 0;
-    return array;
-}
-
-static void free_array(int ** array, int N) {
-    int i;
-    for (i = 0 ; i < N ; i++)
-        free(array[i]);
-    free(array);
+/* One contiguous, zeroed N x N grid; returns its row pointers */
+static int ** allocate_array(grid_arena * g, int N) {
+    if (grid_alloc(g, N, N, sizeof(int)) != 0) {
+        fprintf(stderr, "Could not allocate a %d x %d array\n", N, N);
+        exit(-1);
+    }
+    return (int **)g->rows;
 }
 
 static void init_random(int ** array1, int ** array2, int N) {
@@ -36,6 +29,29 @@ static void init_random(int ** array1, int ** array2, int N) {
     }
 }
 
+/* One time step of the rows [begin, end) */
+typedef struct {
+    int ** previous, ** current;
+    int N;
+} life_grid;
+
+static void life_rows(long begin, long end, void * arg) {
+    life_grid * g = arg;
+    int ** previous = g->previous, ** current = g->current;
+    int N = g->N, i, j, nbrs;
+    for (i = begin ; i < end ; i++) {
+        for (j = 1 ; j < N-1 ; j++) {
+            nbrs = previous[i+1][j+1] + previous[i+1][j] + previous[i+1][j-1] +
+                   previous[i][j-1] + previous[i][j+1] +
+                   previous[i-1][j-1] + previous[i-1][j] + previous[i-1][j+1];
+            if (nbrs == 3 || (previous[i][j] + nbrs == 3))
+                current[i][j] = 1;
+            else
+                current[i][j] = 0;
+        }
+    }
+}
+
 #ifdef OUTPUT
 static void print_to_pgm(int ** array, int N, int t) {
     int i, j;
@@ -59,9 +75,13 @@ int main (int argc, char * argv[]) {
     int T; // time steps
     int ** current, ** previous; // arrays - one for current timestep, one for previous timestep
     int ** swap; // array pointer
-    int t, i, j, nbrs; // helper variables
-    double time; // variables for timing
-    struct timeval ts, tf;
+    grid_arena current_grid, previous_grid; // memory of the two arrays
+    int t, i, j; // helper variables
+    int ws = ws_requested(); // SCHEDULER=ws runs the rows on the work-stealing scheduler
+    bench_config cfg = bench_config_get(); // warmups and repetitions
+    double *times = bench_times(&cfg);
+    char params[64];
+    perf_region region; // hardware counters of the update loop, with PERF_REGIONS set
 
     /* Read input arguments */
     if (argc != 3) {
@@ -73,52 +93,68 @@ int main (int argc, char * argv[]) {
         T = atoi(argv[2]);
     }
 
-    /* Allocate and initialize matrices */
-    current = allocate_array(N); // allocate array for current timestep
-    previous = allocate_array(N); // allocate array for previous timestep
-    init_random(previous, current, N); // initialize previous array with pattern
+    /* Allocate matrices */
+    current = allocate_array(&current_grid, N); // allocate array for current timestep
+    previous = allocate_array(&previous_grid, N); // allocate array for previous timestep
+    perf_region_init(&region, "life");
+    if (ws) ws_start(omp_get_max_threads());
+
+    for (int rep = -cfg.warmups; rep < cfg.reps; rep++) {
+        /* Every repetition starts from the same pattern; the rows are cleared
+         * by the threads that update them, so their pages are first touched there */
+        #pragma omp parallel for private(j)
+        for (i = 0; i < N; i++)
+            for (j = 0; j < N; j++)
+                current[i][j] = previous[i][j] = 0;
+        srand(1);
+        init_random(previous, current, N); // initialize previous array with pattern
 
-    #ifdef OUTPUT
-    print_to_pgm(previous, N, 0);
-    #endif
+        #ifdef OUTPUT
+        print_to_pgm(previous, N, 0);
+        #endif
 
-    /* Start measuring time */
-    gettimeofday(&ts, NULL);
-
-    /* Game of Life */
-    for (t = 0 ; t < T ; t++) {
-        #pragma omp parallel for private(j, nbrs)
-        for (i = 1 ; i < N-1 ; i++) {
-            for (j = 1 ; j < N-1 ; j++) {
-                nbrs = previous[i+1][j+1] + previous[i+1][j] + previous[i+1][j-1] +
-                       previous[i][j-1] + previous[i][j+1] +
-                       previous[i-1][j-1] + previous[i-1][j] + previous[i-1][j+1];
-                if (nbrs == 3 || (previous[i][j] + nbrs == 3))
-                    current[i][j] = 1;
-                else
-                    current[i][j] = 0;
+        /* Start measuring time */
+        double start = bench_now();
+
+        /* Game of Life */
+        perf_region_begin(&region);
+        for (t = 0 ; t < T ; t++) {
+            life_grid grid = {previous, current, N};
+            if (ws) {
+                ws_parallel_for(1, N-1, 0, life_rows, &grid);
+            } else {
+                #pragma omp parallel for
+                for (i = 1 ; i < N-1 ; i++)
+                    life_rows(i, i+1, &grid);
             }
-        }
 
-        #ifdef OUTPUT
-        print_to_pgm(current, N, t+1);
-        #endif
+            #ifdef OUTPUT
+            print_to_pgm(current, N, t+1);
+            #endif
 
-        // Swap current array with previous array
-        swap = current;
-        current = previous;
-        previous = swap;
+            // Swap current array with previous array
+            swap = current;
+            current = previous;
+            previous = swap;
+        }
+        perf_region_end(&region);
+
+        /* End measuring time */
+        bench_record(times, rep, bench_now() - start);
     }
 
-    /* End measuring time */
-    gettimeofday(&tf, NULL);
-    time = (tf.tv_sec-ts.tv_sec)+(tf.tv_usec-ts.tv_usec)*0.000001;
+    ws_stop();
 
     /* Free memory */
-    free_array(current, N);
-    free_array(previous, N);
-
-    printf("GameOfLife: Size %d Steps %d Time %lf\n", N, T, time);
+    grid_free(&current_grid);
+    grid_free(&previous_grid);
+
+    snprintf(params, sizeof(params), "N=%d,steps=%d,threads=%d,scheduler=%s", N, T, omp_get_max_threads(), ws ? "ws" : "openmp");
+    bench_stats s = bench_report("GOL", params, times, cfg.reps, (double)(N-2) * (N-2) * T, "cells/s");
+    printf("GameOfLife: Size %d Steps %d Time %lf\n", N, T, s.median);
+    perf_region_report(&region, (double)(N-2) * (N-2) * T, "cell", 0);
+    perf_region_close(&region);
+    free(times);
 
     #ifdef OUTPUT
     system(FINALIZE);
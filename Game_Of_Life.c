@@ -14,30 +14,22 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/time.h>
+#include "bench.h"
+#include "grid_alloc.h"
+#include "perf_region.h"
 
 #define FINALIZE "\
 ffmpeg -y -start_number 0 -i out%d.pgm output.gif\n\
 rm *pgm\n\
 "
 
-static int ** allocate_array(int N) {
-	int ** array;
-	int i, j;
-	array = malloc(N * sizeof(int*));
-	for (i = 0; i < N ; i++)
-		array[i] = malloc(N * sizeof(int));
-	for (i = 0; i < N ; i++)
-		for (j = 0; j < N ; j++)
-			array[i][j] = 0;
-	return array;
-}
-
-static void free_array(int ** array, int N) {
-	int i;
-	for (i = 0 ; i < N ; i++)
-		free(array[i]);
-	free(array);
+/* One contiguous, zeroed N x N grid; returns its row pointers */
+static int ** allocate_array(grid_arena * g, int N) {
+	if (grid_alloc(g, N, N, sizeof(int)) != 0) {
+		fprintf(stderr, "Could not allocate a %d x %d array\n", N, N);
+		exit(-1);
+	}
+	return (int **)g->rows;
 }
 
 static void init_random(int ** array1, int ** array2, int N) {
@@ -74,10 +66,13 @@ int main (int argc, char * argv[]) {
 	int T; 				//time steps
 	int ** current, ** previous; 	//arrays - one for current timestep, one for previous timestep
 	int ** swap;			//array pointer
+	grid_arena current_grid, previous_grid;	//memory of the two arrays
 	int t, i, j, nbrs;		//helper variables
 
-	double time;			//variables for timing
-	struct timeval ts,tf;
+	bench_config cfg = bench_config_get();	//warmups and repetitions
+	double *times = bench_times(&cfg);	//timed repetitions
+	char params[64];
+	perf_region region;			//hardware counters of the update loop
 
 	/*Read input arguments*/
 	if (argc != 3) {
@@ -89,46 +84,60 @@ int main (int argc, char * argv[]) {
 		T = atoi(argv[2]);
 	}
 
-	/*Allocate and initialize matrices*/
-	current = allocate_array(N);			//allocate array for current time step
-	previous = allocate_array(N); 			//allocate array for previous time step
+	/*Allocate matrices*/
+	current = allocate_array(&current_grid, N);	//allocate array for current time step
+	previous = allocate_array(&previous_grid, N);	//allocate array for previous time step
+	perf_region_init(&region, "life");
 
-	init_random(previous, current, N);	//initialize previous array with pattern
+	for (int rep = -cfg.warmups; rep < cfg.reps; rep++) {
+		/*Every repetition starts from the same pattern*/
+		for (i = 0 ; i < N ; i++)
+			for (j = 0 ; j < N ; j++)
+				current[i][j] = previous[i][j] = 0;
+		srand(1);
+		init_random(previous, current, N);	//initialize previous array with pattern
 
-	#ifdef OUTPUT
-	print_to_pgm(previous, N, 0);
-	#endif
-
-	/*Game of Life*/
-
-	gettimeofday(&ts,NULL);
-	for (t = 0 ; t < T ; t++) {
-		for (i = 1 ; i < N-1 ; i++)
-			for (j = 1 ; j < N-1 ; j++) {
-				nbrs = previous[i+1][j+1] + previous[i+1][j] + previous[i+1][j-1] \
-					+ previous[i][j-1] + previous[i][j+1] \
-					+ previous[i-1][j-1] + previous[i-1][j] + previous[i-1][j+1];
-				if (nbrs == 3 || ( previous[i][j]+nbrs == 3))
-					current[i][j] = 1;
-				else 
-					current[i][j] = 0;
-			}
-	
 		#ifdef OUTPUT
-		print_to_pgm(current, N, t+1);
+		print_to_pgm(previous, N, 0);
 		#endif
-		//Swap current array with previous array 
-		swap = current;
-		current = previous;
-		previous = swap;
 
+		/*Game of Life*/
+
+		double start = bench_now();
+		perf_region_begin(&region);
+		for (t = 0 ; t < T ; t++) {
+			for (i = 1 ; i < N-1 ; i++)
+				for (j = 1 ; j < N-1 ; j++) {
+					nbrs = previous[i+1][j+1] + previous[i+1][j] + previous[i+1][j-1] \
+						+ previous[i][j-1] + previous[i][j+1] \
+						+ previous[i-1][j-1] + previous[i-1][j] + previous[i-1][j+1];
+					if (nbrs == 3 || ( previous[i][j]+nbrs == 3))
+						current[i][j] = 1;
+					else 
+						current[i][j] = 0;
+				}
+		
+			#ifdef OUTPUT
+			print_to_pgm(current, N, t+1);
+			#endif
+			//Swap current array with previous array 
+			swap = current;
+			current = previous;
+			previous = swap;
+
+		}
+		perf_region_end(&region);
+		bench_record(times, rep, bench_now() - start);
 	}
-	gettimeofday(&tf,NULL);
-	time = (tf.tv_sec-ts.tv_sec)+(tf.tv_usec-ts.tv_usec)*0.000001;
 
-	free_array(current, N);
-	free_array(previous, N);
-	printf("GameOfLife: Size %d Steps %d Time %lf\n", N, T, time);
+	grid_free(&current_grid);
+	grid_free(&previous_grid);
+	snprintf(params, sizeof(params), "N=%d,steps=%d,threads=1", N, T);
+	bench_stats s = bench_report("Game_Of_Life", params, times, cfg.reps, (double)(N-2) * (N-2) * T, "cells/s");
+	printf("GameOfLife: Size %d Steps %d Time %lf\n", N, T, s.median);
+	perf_region_report(&region, (double)(N-2) * (N-2) * T, "cell", 0);
+	perf_region_close(&region);
+	free(times);
 	#ifdef OUTPUT
 	system(FINALIZE);
 	#endif
@@ -4,6 +4,9 @@
 #include <cmath>
 #include <thread>
 #include <mutex>
+#include "async_log.h"
+#include "thread_pool.hpp"
+#include "ws_sched.h"
 
 // Global prime array and mutex for thread safety
 std::vector<bool> prime_array;
@@ -47,29 +50,43 @@ int main() {
     // Step 1: Sequentially compute primes up to sqrt(Max)
     std::vector<int> seeds = compute_primes_up_to_sqrt(sqrt_max);
 
-    // Step 2: Divide the range from sqrt(Max)+1 to Max among threads
-    std::vector<std::thread> threads;
-    int chunk_size = (MAX - sqrt_max) / NUM_THREADS;
-
-    for (int i = 0; i < NUM_THREADS; ++i) {
-        int start = sqrt_max + 1 + i * chunk_size;
-        int end = (i == NUM_THREADS - 1) ? MAX : start + chunk_size - 1;
-        threads.emplace_back(mark_non_primes, start, end, std::cref(seeds));
-    }
+    if (ws_requested()) {
+        // Steps 2 and 3 with SCHEDULER=ws: blocks of whole vector<bool> words,
+        // so no two workers write the same word, handed out by work stealing
+        const int BLOCK = 1 << 16;
+        ws_start(NUM_THREADS);
+        ws_parallel_for(0, MAX / BLOCK + 1, 1, [&](long begin, long end) {
+            for (long b = begin; b < end; ++b) {
+                int start = std::max<long>(sqrt_max + 1, b * BLOCK);
+                int last = std::min<long>(MAX, (b + 1) * BLOCK - 1);
+                if (start <= last) mark_non_primes(start, last, seeds);
+            }
+        });
+        ws_stop();
+    } else {
+        // Step 2: Divide the range from sqrt(Max)+1 to Max among pinned workers
+        ThreadPool pool(NUM_THREADS);
+        int chunk_size = (MAX - sqrt_max) / NUM_THREADS;
 
-    // Step 3: Wait for all threads to complete
-    for (auto& th : threads) {
-        th.join();
+        // Step 3: Run every chunk and wait for all workers to complete
+        pool.run([&](int i) {
+            int start = sqrt_max + 1 + i * chunk_size;
+            int end = (i == NUM_THREADS - 1) ? MAX : start + chunk_size - 1;
+            mark_non_primes(start, end, seeds);
+        });
     }
 
-    // Step 4: Collect and print the unmarked numbers (which are primes)
-    std::cout << "Primes up to " << MAX << " are:\n";
+    // Step 4: Collect and print the unmarked numbers (which are primes);
+    // formatting and writing happen on the log writer thread
+    async_log_start(stdout, ASYNC_LOG_BLOCK);
+    async_log("Primes up to %d are:\n", MAX);
     for (int i = 2; i <= MAX; ++i) {
         if (prime_array[i]) {
-            std::cout << i << " ";
+            async_log("%d ", i);
         }
     }
-    std::cout << std::endl;
+    async_log("\n");
+    async_log_stop();
 
     return 0;
 }
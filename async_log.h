@@ -0,0 +1,300 @@
+/* Asynchronous logging
+ * async_log() does not format or write anything on the calling thread. It
+ * stores a binary record (timestamp, format string pointer as the format
+ * id, raw arguments) in a ring buffer owned by the calling thread, and a
+ * background thread collects the records of all threads, orders them by
+ * timestamp, formats them with printf and writes them in large batches.
+ * The logging threads take no lock and make no system call.
+ *
+ * The timestamp order holds within one collected batch only. A record that
+ * reaches its ring after the writer collected a batch holding newer records
+ * of other threads is written after them. Records of one thread always
+ * appear in the order it logged them.
+ *
+ * The format must be a string literal (or otherwise outlive the record),
+ * as must any %s argument. At most ASYNC_LOG_MAX_ARGS conversions are
+ * kept, and '*' widths are not supported. No newline is added.
+ *
+ * When a thread's ring is full, ASYNC_LOG_DROP discards the record (the
+ * writer reports how many were lost) and ASYNC_LOG_BLOCK waits for space.
+ * Before async_log_start() and after async_log_stop() records are printed
+ * directly. The state is per translation unit: log from one file only.
+ *
+ * Usable from C and C++ (GCC builtins for atomics, pthreads for the writer).
+*/
+
+#ifndef ASYNC_LOG_H
+#define ASYNC_LOG_H
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define ASYNC_LOG_MAX_ARGS 6
+#define ASYNC_LOG_RING 4096      /* records per thread, a power of two */
+#define ASYNC_LOG_BATCH 16384    /* records formatted per writer pass */
+#define ASYNC_LOG_BUFFER 65536   /* bytes written per fwrite */
+#define ASYNC_LOG_IDLE_NS 1000000
+
+enum async_log_policy { ASYNC_LOG_DROP, ASYNC_LOG_BLOCK };
+
+enum async_log_type { ASYNC_LOG_INT, ASYNC_LOG_LONG, ASYNC_LOG_LLONG, ASYNC_LOG_DOUBLE, ASYNC_LOG_POINTER, ASYNC_LOG_NONE };
+
+typedef union {
+    long long i;
+    double d;
+    const void *p;
+} async_log_arg;
+
+typedef struct {
+    uint64_t timestamp;
+    const char *format;
+    async_log_arg args[ASYNC_LOG_MAX_ARGS];
+} async_log_record;
+
+/* Single producer (the owning thread), single consumer (the writer) */
+typedef struct async_log_ring {
+    async_log_record records[ASYNC_LOG_RING];
+    uint64_t head __attribute__((aligned(64))); /* next record to format */
+    uint64_t tail __attribute__((aligned(64))); /* next record to fill */
+    uint64_t dropped;
+    struct async_log_ring *next;
+} async_log_ring;
+
+static struct {
+    FILE *out;
+    int policy;
+    int running;
+    unsigned generation; /* bumped by every start, so stale rings are not reused */
+    async_log_ring *rings; /* every thread's ring, newest first */
+    pthread_t writer;
+} async_log_state;
+
+static __thread async_log_ring *async_log_mine;
+static __thread unsigned async_log_mine_generation;
+
+static inline uint64_t async_log_now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000u + t.tv_nsec;
+}
+
+/* Copies the conversion starting at '%' into spec and returns the character
+ * after it; type tells which argument it takes */
+static inline const char *async_log_spec(const char *f, char *spec, int *type) {
+    size_t n = 0;
+    int longs = 0;
+    spec[n++] = *f++;
+    while (*f != '\0' && strchr("diouxXcsfFeEgGaAp%", *f) == NULL && n < 14) {
+        if (*f == 'l' || *f == 'z' || *f == 't' || *f == 'j') longs += (*f == 'j') ? 2 : 1;
+        spec[n++] = *f++;
+    }
+    char c = *f;
+    if (c != '\0') spec[n++] = *f++;
+    spec[n] = '\0';
+
+    if (c == '%' || c == '\0') *type = ASYNC_LOG_NONE;
+    else if (strchr("fFeEgGaA", c) != NULL) *type = ASYNC_LOG_DOUBLE;
+    else if (c == 's' || c == 'p') *type = ASYNC_LOG_POINTER;
+    else *type = (longs >= 2) ? ASYNC_LOG_LLONG : (longs == 1) ? ASYNC_LOG_LONG : ASYNC_LOG_INT;
+    return f;
+}
+
+/* Formats one record into out; returns the number of bytes written */
+static inline size_t async_log_format(char *out, size_t size, const async_log_record *r) {
+    const char *f = r->format;
+    size_t len = 0;
+    int arg = 0;
+    while (*f != '\0' && len + 1 < size) {
+        if (*f != '%') {
+            out[len++] = *f++;
+            continue;
+        }
+        char spec[16];
+        int type, n = 0;
+        f = async_log_spec(f, spec, &type);
+        if (type == ASYNC_LOG_NONE) {
+            n = (spec[1] == '%') ? snprintf(out + len, size - len, "%%") : 0;
+        } else if (arg < ASYNC_LOG_MAX_ARGS) {
+            async_log_arg a = r->args[arg++];
+            switch (type) {
+                case ASYNC_LOG_INT: n = snprintf(out + len, size - len, spec, (int)a.i); break;
+                case ASYNC_LOG_LONG: n = snprintf(out + len, size - len, spec, (long)a.i); break;
+                case ASYNC_LOG_LLONG: n = snprintf(out + len, size - len, spec, a.i); break;
+                case ASYNC_LOG_DOUBLE: n = snprintf(out + len, size - len, spec, a.d); break;
+                default: n = snprintf(out + len, size - len, spec, a.p); break;
+            }
+        }
+        len += (n < 0) ? 0 : ((size_t)n < size - len ? (size_t)n : size - len - 1);
+    }
+    return len;
+}
+
+/* A collected record and its position in the batch, for a stable sort;
+ * batches are written as they are sorted, not merged with later ones */
+typedef struct {
+    async_log_record record;
+    size_t order;
+} async_log_entry;
+
+static inline int async_log_compare(const void *a, const void *b) {
+    const async_log_entry *x = (const async_log_entry *)a, *y = (const async_log_entry *)b;
+    if (x->record.timestamp != y->record.timestamp) return x->record.timestamp < y->record.timestamp ? -1 : 1;
+    return x->order < y->order ? -1 : (x->order > y->order);
+}
+
+/* Moves up to max records from every ring into batch */
+static inline size_t async_log_collect(async_log_entry *batch, size_t max) {
+    size_t n = 0;
+    for (async_log_ring *r = __atomic_load_n(&async_log_state.rings, __ATOMIC_ACQUIRE); r != NULL && n < max; r = r->next) {
+        uint64_t head = r->head, tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+        for (; head != tail && n < max; head++, n++) {
+            batch[n].record = r->records[head & (ASYNC_LOG_RING - 1)];
+            batch[n].order = n;
+        }
+        __atomic_store_n(&r->head, head, __ATOMIC_RELEASE);
+    }
+    return n;
+}
+
+static inline void *async_log_writer(void *unused) {
+    (void)unused;
+    async_log_entry *batch = (async_log_entry *)malloc(ASYNC_LOG_BATCH * sizeof(async_log_entry));
+    char *buffer = (char *)malloc(ASYNC_LOG_BUFFER);
+    uint64_t reported = 0;
+    int idle = 0;
+    for (;;) {
+        int stopping = !__atomic_load_n(&async_log_state.running, __ATOMIC_ACQUIRE);
+        size_t n = async_log_collect(batch, ASYNC_LOG_BATCH);
+        qsort(batch, n, sizeof(async_log_entry), async_log_compare);
+
+        size_t len = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (ASYNC_LOG_BUFFER - len < 4096) {
+                fwrite(buffer, 1, len, async_log_state.out);
+                len = 0;
+            }
+            len += async_log_format(buffer + len, 4096, &batch[i].record);
+        }
+
+        uint64_t dropped = 0;
+        for (async_log_ring *r = __atomic_load_n(&async_log_state.rings, __ATOMIC_ACQUIRE); r != NULL; r = r->next) {
+            dropped += __atomic_load_n(&r->dropped, __ATOMIC_RELAXED);
+        }
+        if (dropped > reported) {
+            if (ASYNC_LOG_BUFFER - len < 4096) {
+                fwrite(buffer, 1, len, async_log_state.out);
+                len = 0;
+            }
+            len += snprintf(buffer + len, ASYNC_LOG_BUFFER - len, "[async_log: %llu records dropped]\n",
+                            (unsigned long long)(dropped - reported));
+            reported = dropped;
+        }
+        if (len > 0) {
+            fwrite(buffer, 1, len, async_log_state.out);
+            fflush(async_log_state.out);
+        }
+
+        /* poll eagerly while records keep coming, sleep once the rings stay empty */
+        idle = (n == 0) ? idle + 1 : 0;
+        if (n == 0 && stopping) break;
+        if (idle > 64) {
+            struct timespec pause = {0, ASYNC_LOG_IDLE_NS};
+            nanosleep(&pause, NULL);
+        } else if (n < ASYNC_LOG_BATCH) {
+            sched_yield();
+        }
+    }
+    free(batch);
+    free(buffer);
+    return NULL;
+}
+
+/* Starts the writer thread; out is typically stdout */
+static inline int async_log_start(FILE *out, enum async_log_policy policy) {
+    fflush(out);
+    async_log_state.out = out;
+    async_log_state.policy = policy;
+    async_log_state.generation++;
+    __atomic_store_n(&async_log_state.running, 1, __ATOMIC_RELEASE);
+    if (pthread_create(&async_log_state.writer, NULL, async_log_writer, NULL) != 0) {
+        async_log_state.running = 0;
+        return -1;
+    }
+    return 0;
+}
+
+/* Writes every pending record and stops the writer. Threads should have
+ * stopped logging; later records are printed directly. */
+static inline void async_log_stop(void) {
+    if (!__atomic_load_n(&async_log_state.running, __ATOMIC_ACQUIRE)) return;
+    __atomic_store_n(&async_log_state.running, 0, __ATOMIC_RELEASE);
+    pthread_join(async_log_state.writer, NULL);
+    for (async_log_ring *r = async_log_state.rings, *next; r != NULL; r = next) {
+        next = r->next;
+        free(r);
+    }
+    async_log_state.rings = NULL;
+}
+
+static inline async_log_ring *async_log_register(void) {
+    async_log_ring *r = (async_log_ring *)aligned_alloc(64, sizeof(async_log_ring));
+    memset(r, 0, sizeof(async_log_ring));
+    r->next = __atomic_load_n(&async_log_state.rings, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&async_log_state.rings, &r->next, r, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+    async_log_mine = r;
+    async_log_mine_generation = async_log_state.generation;
+    return r;
+}
+
+__attribute__((format(printf, 1, 2)))
+static inline void async_log(const char *format, ...) {
+    va_list ap;
+    va_start(ap, format);
+    if (!__atomic_load_n(&async_log_state.running, __ATOMIC_ACQUIRE)) {
+        vprintf(format, ap);
+        va_end(ap);
+        return;
+    }
+
+    async_log_ring *r = (async_log_mine != NULL && async_log_mine_generation == async_log_state.generation)
+                            ? async_log_mine : async_log_register();
+    uint64_t tail = r->tail;
+    while (tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == ASYNC_LOG_RING) {
+        if (async_log_state.policy == ASYNC_LOG_DROP) {
+            __atomic_store_n(&r->dropped, r->dropped + 1, __ATOMIC_RELAXED);
+            va_end(ap);
+            return;
+        }
+        sched_yield();
+    }
+
+    async_log_record *record = &r->records[tail & (ASYNC_LOG_RING - 1)];
+    record->timestamp = async_log_now();
+    record->format = format;
+    int arg = 0;
+    for (const char *f = format; *f != '\0' && arg < ASYNC_LOG_MAX_ARGS; ) {
+        if (*f++ != '%') continue;
+        char spec[16];
+        int type;
+        f = async_log_spec(f - 1, spec, &type);
+        switch (type) {
+            case ASYNC_LOG_INT: record->args[arg++].i = va_arg(ap, int); break;
+            case ASYNC_LOG_LONG: record->args[arg++].i = va_arg(ap, long); break;
+            case ASYNC_LOG_LLONG: record->args[arg++].i = va_arg(ap, long long); break;
+            case ASYNC_LOG_DOUBLE: record->args[arg++].d = va_arg(ap, double); break;
+            case ASYNC_LOG_POINTER: record->args[arg++].p = va_arg(ap, const void *); break;
+            default: break;
+        }
+    }
+    va_end(ap);
+    __atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+#endif /* ASYNC_LOG_H */
@@ -0,0 +1,159 @@
+/* Benchmark harness
+ * Programs time their kernels with bench_now() (CLOCK_MONOTONIC), run
+ * BENCH_WARMUPS untimed and BENCH_REPS timed repetitions (by default none
+ * and one, i.e. a single run as before) and hand the times to
+ * bench_report(). It summarises them as min, median, p95, mean, standard
+ * deviation and throughput (work / median).
+ *
+ * BENCH_FORMAT selects the output: text (a summary line when there is more
+ * than one repetition), json (one object per line) or csv (one row, with a
+ * header if the file is new). BENCH_OUTPUT names a file to append to;
+ * otherwise the summary goes to stdout. Parameters are passed as
+ * "name=value,name=value" and become a JSON object or a CSV column.
+ *
+ * Usage:
+ *     bench_config cfg = bench_config_get();
+ *     double *times = bench_times(&cfg);
+ *     for (int rep = -cfg.warmups; rep < cfg.reps; rep++) {
+ *         reset the inputs
+ *         double start = bench_now();
+ *         kernel
+ *         bench_record(times, rep, bench_now() - start);
+ *     }
+ *     bench_report("program", "N=1000,threads=4", times, cfg.reps, work, "GFLOP/s");
+*/
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct {
+    int warmups; /* untimed runs before the timed ones */
+    int reps;    /* timed runs, at least 1 */
+} bench_config;
+
+typedef struct {
+    int runs;
+    double min, median, p95, mean, stddev;
+} bench_stats;
+
+static inline double bench_now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static inline int bench_env(const char *name, int fallback, int min) {
+    const char *value = getenv(name);
+    int v = (value != NULL && value[0] != '\0') ? atoi(value) : fallback;
+    return v < min ? min : v;
+}
+
+static inline bench_config bench_config_get(void) {
+    bench_config cfg;
+    cfg.warmups = bench_env("BENCH_WARMUPS", 0, 0);
+    cfg.reps = bench_env("BENCH_REPS", 1, 1);
+    return cfg;
+}
+
+static inline double *bench_times(const bench_config *cfg) {
+    return (double *)calloc(cfg->reps, sizeof(double));
+}
+
+/* Stores the time of repetition rep; warmups (rep < 0) are dropped */
+static inline void bench_record(double *times, int rep, double seconds) {
+    if (rep >= 0) times[rep] = seconds;
+}
+
+static inline int bench_compare(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static inline bench_stats bench_summarize(const double *times, int n) {
+    bench_stats s = {n, 0, 0, 0, 0, 0};
+    if (n < 1) return s;
+    double *sorted = (double *)malloc(n * sizeof(double));
+    memcpy(sorted, times, n * sizeof(double));
+    qsort(sorted, n, sizeof(double), bench_compare);
+
+    s.min = sorted[0];
+    s.median = (n % 2) ? sorted[n / 2] : 0.5 * (sorted[n / 2 - 1] + sorted[n / 2]);
+    s.p95 = sorted[(int)ceil(0.95 * n) - 1]; /* nearest rank */
+    for (int i = 0; i < n; i++) s.mean += sorted[i] / n;
+    for (int i = 0; i < n; i++) s.stddev += (sorted[i] - s.mean) * (sorted[i] - s.mean);
+    s.stddev = (n > 1) ? sqrt(s.stddev / (n - 1)) : 0;
+    free(sorted);
+    return s;
+}
+
+/* Writes "name=value,..." as JSON members, quoting values that are not numbers */
+static inline void bench_json_params(FILE *f, const char *params) {
+    char copy[512];
+    snprintf(copy, sizeof(copy), "%s", params);
+    int first = 1;
+    for (char *item = strtok(copy, ","); item != NULL; item = strtok(NULL, ",")) {
+        char *eq = strchr(item, '=');
+        if (eq == NULL) continue;
+        *eq = '\0';
+        char *end;
+        strtod(eq + 1, &end);
+        int number = eq[1] != '\0' && *end == '\0';
+        fprintf(f, number ? "%s\"%s\":%s" : "%s\"%s\":\"%s\"", first ? "" : ",", item, eq + 1);
+        first = 0;
+    }
+}
+
+/* Whether BENCH_FORMAT asks for machine-readable output */
+static inline int bench_machine_output(void) {
+    const char *format = getenv("BENCH_FORMAT");
+    return format != NULL && (strcmp(format, "json") == 0 || strcmp(format, "csv") == 0);
+}
+
+/* Summarises n timed runs of `work` units each and reports them */
+static inline bench_stats bench_report(const char *program, const char *params, const double *times, int n,
+                                       double work, const char *unit) {
+    bench_stats s = bench_summarize(times, n);
+    double throughput = (s.median > 0) ? work / s.median : 0;
+    const char *output = getenv("BENCH_OUTPUT");
+    if (!bench_machine_output()) {
+        if (n > 1) {
+            printf("%s [%s]: median %.6f s, p95 %.6f s, stddev %.6f s, min %.6f s over %d runs, %.4g %s\n",
+                   program, params, s.median, s.p95, s.stddev, s.min, n, throughput, unit);
+        }
+        return s;
+    }
+
+    FILE *f = (output != NULL && output[0] != '\0') ? fopen(output, "a") : stdout;
+    if (f == NULL) {
+        fprintf(stderr, "Error: could not open the benchmark output file %s\n", output);
+        return s;
+    }
+    if (strcmp(getenv("BENCH_FORMAT"), "csv") == 0) {
+        // A header per new file, and once per process on stdout
+        static int stdout_header = 0;
+        int header = (f == stdout) ? !stdout_header : (fseek(f, 0, SEEK_END) == 0 && ftell(f) == 0);
+        if (f == stdout) stdout_header = 1;
+        if (header) {
+            fprintf(f, "program,params,runs,min,median,p95,mean,stddev,throughput,unit\n");
+        }
+        fprintf(f, "%s,\"%s\",%d,%.9f,%.9f,%.9f,%.9f,%.9f,%.6g,%s\n",
+                program, params, n, s.min, s.median, s.p95, s.mean, s.stddev, throughput, unit);
+    } else {
+        fprintf(f, "{\"program\":\"%s\",\"params\":{", program);
+        bench_json_params(f, params);
+        fprintf(f, "},\"runs\":%d,\"min\":%.9f,\"median\":%.9f,\"p95\":%.9f,\"mean\":%.9f,\"stddev\":%.9f,"
+                   "\"throughput\":%.6g,\"unit\":\"%s\"}\n",
+                n, s.min, s.median, s.p95, s.mean, s.stddev, throughput, unit);
+    }
+    if (f != stdout) fclose(f);
+    else fflush(f);
+    return s;
+}
+
+#endif /* BENCH_H */
@@ -0,0 +1,24 @@
+/* Counter-based random number generator
+ * Each value is a pure function of (seed, counter), so any thread can
+ * generate any element of a matrix without shared state, and the result
+ * does not depend on the number of threads or the loop schedule.
+ * The mixing function is the SplitMix64 finalizer.
+*/
+
+#ifndef COUNTER_RNG_H
+#define COUNTER_RNG_H
+
+#include <stdint.h>
+
+static inline uint64_t counter_rng_mix(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Returns the counter-th random value of the stream selected by seed
+static inline uint64_t counter_rng(uint64_t seed, uint64_t counter) {
+    return counter_rng_mix(counter_rng_mix(seed) + (counter + 1) * 0x9E3779B97F4A7C15ULL);
+}
+
+#endif /* COUNTER_RNG_H */
@@ -0,0 +1,177 @@
+// Shared counters for many writer threads
+//
+// All counters have the same interface, add(delta) and value(), so they can
+// be swapped in benchmarks:
+//
+//   MutexCounter      a long guarded by a std::mutex (the baseline)
+//   AtomicCounter     one std::atomic<long>, relaxed ordering
+//   ShardedCounter    one cache-line-padded shard per thread; value() sums
+//                     the shards, so writers never share a line
+//   CombiningCounter  flat combining: threads publish their delta in their
+//                     own slot and whoever holds the lock applies them all
+//
+// Threads are mapped to shards and slots by a per-thread index, modulo the
+// number of shards, so any number of threads may use a counter.
+
+#ifndef COUNTERS_HPP
+#define COUNTERS_HPP
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "thread_pool.hpp"
+
+// Small dense index of the calling thread, assigned on first use
+inline unsigned counter_thread_index()
+{
+  static std::atomic<unsigned> next(0);
+  thread_local unsigned index = next.fetch_add(1, std::memory_order_relaxed);
+  return index;
+}
+
+inline unsigned default_shards()
+{
+  unsigned n = std::thread::hardware_concurrency();
+  return n > 0 ? n : 1;
+}
+
+class MutexCounter
+{
+public:
+  explicit MutexCounter(unsigned = 0) {}
+
+  void add(long delta)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    count += delta;
+  }
+
+  long value()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return count;
+  }
+
+private:
+  std::mutex mutex;
+  long count = 0;
+};
+
+class AtomicCounter
+{
+public:
+  explicit AtomicCounter(unsigned = 0) {}
+
+  void add(long delta)
+  {
+    count.fetch_add(delta, std::memory_order_relaxed);
+  }
+
+  long value()
+  {
+    return count.load(std::memory_order_relaxed);
+  }
+
+private:
+  alignas(64) std::atomic<long> count{0};
+};
+
+class ShardedCounter
+{
+public:
+  explicit ShardedCounter(unsigned shards = default_shards()) : shards(shards > 0 ? shards : 1) {}
+
+  // Shards are only shared by threads whose indexes collide, so the
+  // read-modify-write is almost always uncontended
+  void add(long delta)
+  {
+    shards[counter_thread_index() % shards.size()].count.fetch_add(delta, std::memory_order_relaxed);
+  }
+
+  // Sum of the shards; concurrent adds may or may not be included
+  long value()
+  {
+    long sum = 0;
+    for (auto const &s : shards)
+      {
+        sum += s.count.load(std::memory_order_relaxed);
+      }
+    return sum;
+  }
+
+private:
+  struct alignas(64) Shard
+  {
+    std::atomic<long> count{0};
+  };
+  std::vector<Shard> shards;
+};
+
+class CombiningCounter
+{
+public:
+  explicit CombiningCounter(unsigned slots = default_shards()) : slots(slots > 0 ? slots : 1) {}
+
+  // Returns once the delta has been applied, by this thread or by a combiner
+  void add(long delta)
+  {
+    if (delta == 0)
+      {
+        return;
+      }
+    std::atomic<long> &pending = slots[counter_thread_index() % slots.size()].pending;
+    pending.fetch_add(delta, std::memory_order_release);
+    for (int spin=0; pending.load(std::memory_order_acquire) != 0; ++spin)
+      {
+        if (!locked.exchange(true, std::memory_order_acquire))
+          {
+            combine();
+            locked.store(false, std::memory_order_release);
+          }
+        else if (spin < 4096)
+          {
+            cpu_relax();
+          }
+        else
+          {
+            std::this_thread::yield();
+          }
+      }
+  }
+
+  long value()
+  {
+    while (locked.exchange(true, std::memory_order_acquire))
+      {
+        std::this_thread::yield();
+      }
+    combine();
+    long result = count;
+    locked.store(false, std::memory_order_release);
+    return result;
+  }
+
+private:
+  // Applies every published delta; the caller holds the lock
+  void combine()
+  {
+    for (auto &s : slots)
+      {
+        if (s.pending.load(std::memory_order_relaxed) != 0)
+          {
+            count += s.pending.exchange(0, std::memory_order_acq_rel);
+          }
+      }
+  }
+
+  struct alignas(64) Slot
+  {
+    std::atomic<long> pending{0};
+  };
+  std::vector<Slot> slots;
+  alignas(64) std::atomic<bool> locked{false};
+  long count = 0;  // only touched by the lock holder
+};
+
+#endif // COUNTERS_HPP
@@ -2,10 +2,22 @@
 #include <stdlib.h>
 #include <omp.h>
 #include <time.h>
+#include <string.h>
 #include <math.h> // Include math.h for fabs
+#include "bench.h"
+#include "counter_rng.h"
+#include "grid_alloc.h"
+#include "perf_region.h"
+#include "tuning.h"
+#include "ws_sched.h"
 
+#ifndef SIZE
 #define SIZE 42000 /* Array size */
+#endif
 #define TOLERANCE 1e-6 // Define a tolerance for comparison
+#define TUNE_REPS 3 /* Timed runs per autotuning candidate, best one counts */
+#define WS_COLUMN_GRAIN 1024 /* Rows per piece of a column update on the work-stealing scheduler */
+#define WS_DOT_GRAIN 4096 /* Columns below which a row's dot product is not split further */
 
 void row_oriented_back_substitution(double **A, double *b, double *x) {
     int row,col;
@@ -50,50 +62,274 @@ void column_oriented_back_substitution(double **A, double *b, double *x) {
     }
 }
 
+/* Work-stealing versions of both solvers (SCHEDULER=ws) */
+typedef struct {
+    double **A;
+    double *b, *x;
+    int col;
+} back_substitution_step;
+
+/* Part of the dot product of a row of A with x, summed by recursive halving */
+typedef struct {
+    const double *a, *x;
+    long begin, end;
+    double sum;
+} dot_range;
+
+static void dot_ws(void *arg) {
+    dot_range *d = arg;
+    if (d->end - d->begin <= WS_DOT_GRAIN) {
+        double sum = 0;
+        for (long col = d->begin; col < d->end; col++) {
+            sum += d->a[col] * d->x[col];
+        }
+        d->sum = sum;
+        return;
+    }
+    long middle = d->begin + (d->end - d->begin) / 2;
+    dot_range left = {d->a, d->x, d->begin, middle, 0}, right = {d->a, d->x, middle, d->end, 0};
+    ws_group g = WS_GROUP_INIT;
+    ws_spawn(&g, dot_ws, &left);
+    dot_ws(&right);
+    ws_sync(&g);
+    d->sum = left.sum + right.sum;
+}
+
+static void column_range(long begin, long end, void *arg) {
+    back_substitution_step *s = arg;
+    for (long row = begin; row < end; row++) {
+        s->x[row] -= s->A[row][s->col] * s->x[s->col];
+    }
+}
+
+/* Row r needs every x[col] with col > r, so the rows stay sequential and
+ * only the dot product over the solved part of each row is split */
+void row_oriented_back_substitution_ws(double **A, double *b, double *x) {
+    for (int row = SIZE - 1; row >= 0; row--) {
+        dot_range d = {A[row], x, row + 1, SIZE, 0};
+        dot_ws(&d);
+        x[row] = (b[row] - d.sum) / A[row][row];
+    }
+}
+
+void column_oriented_back_substitution_ws(double **A, double *b, double *x) {
+    back_substitution_step s = {A, b, x, 0};
+    for (int row = 0; row < SIZE; row++) {
+        x[row] = b[row];
+    }
+    // The rows above each column shrink as we go, stealing balances them
+    for (s.col = SIZE - 1; s.col >= 0; s.col--) {
+        x[s.col] /= A[s.col][s.col];
+        ws_parallel_for(0, s.col, WS_COLUMN_GRAIN, column_range, &s);
+    }
+}
+
+/* OpenMP settings a solver runs with */
+typedef struct {
+    int threads;
+    omp_sched_t kind;
+    int chunk;
+} solver_settings;
+
+typedef void (*solver)(double **A, double *b, double *x);
+
+static const char *schedule_names[] = {"auto", "static", "dynamic", "guided", "auto"};
+
+static void apply_settings(solver_settings s) {
+    omp_set_num_threads(s.threads);
+    omp_set_schedule(s.kind, s.chunk);
+}
+
+/* Best time out of TUNE_REPS runs of solve with the given settings */
+static double time_solver(solver solve, double **A, double *b, double *x, solver_settings s) {
+    double best = 0;
+    apply_settings(s);
+    for (int r = 0; r < TUNE_REPS; r++) {
+        double start_time = bench_now();
+        solve(A, b, x);
+        double elapsed = bench_now() - start_time;
+        if (r == 0 || elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+/* Whether x is the solution ref, up to rounding (NaNs match NaNs) */
+static int same_solution(const double *x, const double *ref) {
+    for (int i = 0; i < SIZE; i++) {
+        if (x[i] != ref[i] && !(isnan(x[i]) && isnan(ref[i])) && !(fabs(x[i] - ref[i]) <= TOLERANCE * fabs(ref[i]))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Searches the thread count (with a static schedule), then the schedule kind
+ * and chunk size for one solver, and stores the winner in the tuning file.
+ * A candidate counts only if it reproduces the single-threaded solution. */
+static void autotune_solver(const char *kernel, solver solve, double **A, double *b, double *x, int max_threads) {
+    static const omp_sched_t kinds[] = {omp_sched_static, omp_sched_dynamic, omp_sched_guided};
+    static const int chunks[] = {0, 1, 8, 64, 512};
+    solver_settings best = {1, omp_sched_static, 0}, s = best;
+    double best_time = -1, t;
+    double *ref = malloc(SIZE * sizeof(double));
+    apply_settings(best);
+    solve(A, b, ref);
+
+    // Powers of two up to max_threads, plus max_threads
+    for (s.threads = 1; ; s.threads = (s.threads * 2 < max_threads) ? s.threads * 2 : max_threads) {
+        t = time_solver(solve, A, b, x, s);
+        if (!same_solution(x, ref)) {
+            printf("Rejected %s with %d threads: wrong solution\n", kernel, s.threads);
+        } else if (best_time < 0 || t < best_time) {
+            best_time = t;
+            best = s;
+        }
+        if (s.threads == max_threads) break;
+    }
+
+    s.threads = best.threads;
+    for (int k = 0; k < 3; k++) {
+        for (int c = 0; c < 5; c++) {
+            s.kind = kinds[k];
+            s.chunk = chunks[c];
+            t = time_solver(solve, A, b, x, s);
+            if (!same_solution(x, ref)) {
+                printf("Rejected %s with %d threads, schedule(%s, %d): wrong solution\n",
+                       kernel, s.threads, schedule_names[s.kind], s.chunk);
+            } else if (t < best_time) {
+                best_time = t;
+                best = s;
+            }
+        }
+    }
+
+    char shape[32], params[TUNING_LINE];
+    snprintf(shape, sizeof(shape), "%d", SIZE);
+    snprintf(params, sizeof(params), "threads=%d schedule=%d chunk=%d time_us=%d",
+             best.threads, (int)best.kind, best.chunk, (int)(best_time * 1e6));
+    if (tuning_store(kernel, shape, params) != 0) {
+        printf("Error: could not write the tuning file %s\n", tuning_path());
+    }
+    printf("Tuned %s: %d threads, schedule(%s, %d), %.6f seconds\n",
+           kernel, best.threads, schedule_names[best.kind], best.chunk, best_time);
+    free(ref);
+}
+
+/* Settings for a solver: the tuning file, unless OMP_SCHEDULE is set,
+ * with num_threads overriding the tuned thread count when positive */
+static solver_settings load_settings(const char *kernel, int num_threads, solver_settings defaults) {
+    solver_settings s = defaults;
+    char shape[32], params[TUNING_LINE];
+
+    if (num_threads > 0) s.threads = num_threads;
+    snprintf(shape, sizeof(shape), "%d", SIZE);
+    if (getenv("OMP_SCHEDULE") == NULL && tuning_load(kernel, shape, params, sizeof(params))) {
+        s.kind = (omp_sched_t)tuning_get(params, "schedule", s.kind);
+        s.chunk = tuning_get(params, "chunk", s.chunk);
+        if (num_threads <= 0) s.threads = tuning_get(params, "threads", s.threads);
+    }
+    return s;
+}
+
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        printf("Usage: %s <num_threads>\n", argv[0]);
+    int tune = (argc >= 2 && strcmp(argv[1], "tune") == 0);
+    if (argc - tune != 2 && argc - tune != 3) {
+        printf("Usage: %s <num_threads (0 = tuned)> [seed]\n", argv[0]);
+        printf("       %s tune <max_threads> [seed]\n", argv[0]);
         return -1;
     }
 
-    int num_threads = atoi(argv[1]);
+    int num_threads = atoi(argv[1 + tune]);
+    // Seed the random number generator with the given seed or the current time
+    uint64_t seed = (argc - tune == 3) ? strtoull(argv[2 + tune], NULL, 10) : (uint64_t)time(0);
     int i, j;
-    double start_time, end_time;
+    bench_config cfg = bench_config_get();
+    double *times = bench_times(&cfg);
+    char params[64];
+    double flops = (double)SIZE * SIZE * 1e-9; // one multiply and one subtract per element of the triangle
+    double triangle = (double)SIZE * (SIZE + 1) / 2;
+    perf_region region; // hardware counters of each solver, with PERF_REGIONS set
 
     /* Shared Variables */
-    double **A = malloc(SIZE * sizeof(double *));  // Upper triangular matrix
+    grid_arena a_grid;                             // One contiguous region for A
+    if (grid_alloc(&a_grid, SIZE, SIZE, sizeof(double)) != 0) {
+        printf("Error: could not allocate a %d x %d matrix\n", SIZE, SIZE);
+        return -1;
+    }
+    double **A = (double **)a_grid.rows;           // Upper triangular matrix
     double *b = malloc(SIZE * sizeof(double));     // Right-hand side vector
     double *x_row = malloc(SIZE * sizeof(double)); // Solution vector for row-oriented back substitution
     double *x_col = malloc(SIZE * sizeof(double)); // Solution vector for column-oriented back substitution
 
-    // Allocate each row of the matrix
-    for (int i = 0; i < SIZE; ++i) {
-        A[i] = malloc(SIZE * sizeof(double));
-    }
+    // Settings from OMP_SCHEDULE and the machine, before any tuning changes them
+    solver_settings defaults = {omp_get_num_procs(), omp_sched_static, 0}, row_settings, col_settings;
+    omp_get_schedule(&defaults.kind, &defaults.chunk);
+    if (tune && num_threads < 1) num_threads = defaults.threads;
+
+    // The row solver is not tuned: its rows depend on each other, so any
+    // parallel schedule of them races. Initialize with its schedule, so rows
+    // land where it reads them.
+    row_settings = defaults;
+    if (num_threads > 0) row_settings.threads = num_threads;
+    apply_settings(row_settings);
 
-    // Seed the random number generator with the current time
-    srand(time(0));  
-    /* Initializes the A and b with random numbers between 1 and 10*/
+    /* Initializes A and b with random numbers between 1 and 10.
+     * Rows are handed out with the same schedule(runtime) as the solvers, so the
+     * pages of each row are first touched by the thread that will read them.
+     * Element (i, j) always gets the same value for a given seed. */
+    #pragma omp parallel for schedule(runtime) default(shared) private(i,j)
     for(i = 0; i < SIZE; i++) {
         for(j = 0; j < SIZE; j++) {
-                A[i][j] = (i <= j) ? (rand() % 10) + 1 : 0; // Upper triangular matrix
+                A[i][j] = (i <= j) ? (counter_rng(seed, (uint64_t)i * SIZE + j) % 10) + 1 : 0; // Upper triangular matrix
         }
-        b[i] = (rand() % 10) + 1;
+        b[i] = (counter_rng(seed, (uint64_t)SIZE * SIZE + i) % 10) + 1;
     }
 
-    omp_set_num_threads(num_threads);
+    if (tune) {
+        autotune_solver("gaussian_col", column_oriented_back_substitution, A, b, x_col, num_threads);
+    }
 
     // Measure the execution time for row-oriented back substitution
-    start_time = omp_get_wtime();
-    row_oriented_back_substitution(A, b, x_row);
-    end_time = omp_get_wtime();
-    printf("Row-oriented back substitution execution time: %.15f seconds\n", (end_time - start_time));
+    col_settings = load_settings("gaussian_col", num_threads, defaults);
+    apply_settings(row_settings);
+    perf_region_init(&region, "back_substitution row");
+    // SCHEDULER=ws runs both solvers on the work-stealing scheduler with the row solver's thread count
+    int ws = ws_requested();
+    solver row_solver = ws ? row_oriented_back_substitution_ws : row_oriented_back_substitution;
+    solver col_solver = ws ? column_oriented_back_substitution_ws : column_oriented_back_substitution;
+    if (ws) ws_start(row_settings.threads);
+    for (int rep = -cfg.warmups; rep < cfg.reps; rep++) {
+        double start_time = bench_now();
+        perf_region_begin(&region);
+        row_solver(A, b, x_row);
+        perf_region_end(&region);
+        bench_record(times, rep, bench_now() - start_time);
+    }
+    perf_region_report(&region, triangle, "element", flops * 1e9);
+    perf_region_close(&region);
+    snprintf(params, sizeof(params), "N=%d,threads=%d,variant=row,scheduler=%s",
+             SIZE, row_settings.threads, ws ? "ws" : "openmp");
+    bench_stats stats = bench_report("gaussian_elimination", params, times, cfg.reps, flops, "GFLOP/s");
+    printf("Row-oriented back substitution execution time: %.15f seconds\n", stats.median);
 
     // Measure the execution time for column-oriented back substitution
-    start_time = omp_get_wtime();
-    column_oriented_back_substitution(A, b, x_col);
-    end_time = omp_get_wtime();
-    printf("Column-oriented back substitution execution time: %.15f seconds\n",(end_time - start_time));
+    apply_settings(col_settings);
+    perf_region_init(&region, "back_substitution column");
+    for (int rep = -cfg.warmups; rep < cfg.reps; rep++) {
+        double start_time = bench_now();
+        perf_region_begin(&region);
+        col_solver(A, b, x_col);
+        perf_region_end(&region);
+        bench_record(times, rep, bench_now() - start_time);
+    }
+    perf_region_report(&region, triangle, "element", flops * 1e9);
+    perf_region_close(&region);
+    snprintf(params, sizeof(params), "N=%d,threads=%d,variant=column,scheduler=%s",
+             SIZE, ws ? row_settings.threads : col_settings.threads, ws ? "ws" : "openmp");
+    stats = bench_report("gaussian_elimination", params, times, cfg.reps, flops, "GFLOP/s");
+    printf("Column-oriented back substitution execution time: %.15f seconds\n", stats.median);
+
+    ws_stop();
 
     // Compare the results
     int mismatch = 0;
@@ -108,13 +344,11 @@ int main(int argc, char* argv[]) {
     }
 
     // Free allocated memory
-    for (int i = 0; i < SIZE; ++i) {
-        free(A[i]);
-    }
-    free(A);
+    grid_free(&a_grid);
     free(b);
     free(x_row);
     free(x_col);
+    free(times);
 
     return 0;
 }
@@ -0,0 +1,306 @@
+/* Cache-blocked, register-tiled GEMM for uint16 matrices
+ * Computes C = A * B for A (M x K) and B (K x N) with uint32 results
+ * (wrapping modulo 2^32, like the naive kernels).
+ *
+ * The loops follow the usual BLIS structure: B is packed into a
+ * KC x NC panel of NR-wide slivers (L3), A is packed per thread into an
+ * MC x KC block of MR-tall slivers (L2), and an MR x NR microkernel keeps
+ * the C tile in registers while streaming both slivers from L1.
+ *
+ * The microkernel widens uint16 x uint16 to uint32 with a mullo/mulhi pair
+ * and interleaves the halves with unpacklo/unpackhi. Because the unpack
+ * works per 128-bit lane, B columns are stored permuted inside each sliver
+ * so that the accumulators come out in natural column order.
+ *
+ * Compile with -mavx2 or -mavx512bw (or -march=native) to enable the SIMD
+ * microkernels; otherwise a portable scalar kernel is used.
+*/
+
+#ifndef GEMM_U16_H
+#define GEMM_U16_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#if defined(__AVX512BW__)
+#include <immintrin.h>
+#define GEMM_MR 8
+#define GEMM_NR 32
+#define GEMM_ISA "avx512bw"
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define GEMM_MR 6
+#define GEMM_NR 16
+#define GEMM_ISA "avx2"
+#else
+#define GEMM_MR 4
+#define GEMM_NR 16
+#define GEMM_ISA "scalar"
+#endif
+
+/* Default block sizes: MC x KC of A fits in L2, KC x NR of B fits in L1 */
+#define GEMM_MC 120
+#define GEMM_KC 256
+#define GEMM_NC 4096
+
+typedef struct {
+    int mc, kc, nc;
+} gemm_blocking;
+
+static gemm_blocking gemm_u16_blocking = { GEMM_MC, GEMM_KC, GEMM_NC };
+
+static inline int gemm_round_up(int x, int m) {
+    return (x + m - 1) / m * m;
+}
+
+static inline void *gemm_alloc(size_t bytes) {
+    return aligned_alloc(64, (bytes + 63) / 64 * 64);
+}
+
+/* Pack buffers of gemm_u16_serial_acc(), one pair per thread, kept across
+ * calls so the leaves of the recursive drivers do not allocate. They grow
+ * when the blocking does and are never freed: each thread keeps one packed
+ * A block and one packed B panel (about 2 MB with the default blocking) */
+typedef struct {
+    void *data;
+    size_t bytes;
+} gemm_scratch;
+
+static __thread gemm_scratch gemm_scratch_a, gemm_scratch_b;
+
+static inline void *gemm_scratch_get(gemm_scratch *s, size_t bytes) {
+    if (s->bytes < bytes) {
+        free(s->data);
+        s->data = gemm_alloc(bytes);
+        s->bytes = (s->data != NULL) ? bytes : 0;
+    }
+    return s->data;
+}
+
+/* Column of the sliver stored at position p (see the header comment) */
+static inline int gemm_sliver_col(int p) {
+#if defined(__AVX2__) || defined(__AVX512BW__)
+    int group = p / 4, groups = GEMM_NR / 4;
+    int col_group = (group % 2 == 0) ? group / 2 : groups / 2 + group / 2;
+    return col_group * 4 + p % 4;
+#else
+    return p;
+#endif
+}
+
+/* Packs an mc x kc block of A into MR-tall slivers, zero padded */
+static void gemm_u16_pack_a(int mc, int kc, const uint16_t *A, int lda, uint16_t *Ap) {
+    for (int ir = 0; ir < mc; ir += GEMM_MR) {
+        int mr = (mc - ir < GEMM_MR) ? mc - ir : GEMM_MR;
+        for (int k = 0; k < kc; k++) {
+            for (int r = 0; r < GEMM_MR; r++) {
+                *Ap++ = (r < mr) ? A[(size_t)(ir + r) * lda + k] : 0;
+            }
+        }
+    }
+}
+
+/* Packs the NR-wide sliver of B starting at column jr, zero padded */
+static void gemm_u16_pack_b_sliver(int kc, int nc, int jr, const uint16_t *B, int ldb, uint16_t *Bp) {
+    for (int k = 0; k < kc; k++) {
+        for (int p = 0; p < GEMM_NR; p++) {
+            int col = jr + gemm_sliver_col(p);
+            *Bp++ = (col < nc) ? B[(size_t)k * ldb + col] : 0;
+        }
+    }
+}
+
+/* C tile (MR x NR, row stride ldc) = or += Ap sliver * Bp sliver */
+static void gemm_u16_microkernel(int kc, const uint16_t *Ap, const uint16_t *Bp,
+                                 uint32_t *C, int ldc, int accumulate) {
+#if defined(__AVX512BW__)
+    __m512i c[GEMM_MR][2];
+    for (int r = 0; r < GEMM_MR; r++) {
+        c[r][0] = _mm512_setzero_si512();
+        c[r][1] = _mm512_setzero_si512();
+    }
+    for (int k = 0; k < kc; k++) {
+        __m512i b = _mm512_load_si512((const void *)(Bp + (size_t)k * GEMM_NR));
+        for (int r = 0; r < GEMM_MR; r++) {
+            __m512i a = _mm512_set1_epi16(Ap[k * GEMM_MR + r]);
+            __m512i lo = _mm512_mullo_epi16(a, b);
+            __m512i hi = _mm512_mulhi_epu16(a, b);
+            c[r][0] = _mm512_add_epi32(c[r][0], _mm512_unpacklo_epi16(lo, hi));
+            c[r][1] = _mm512_add_epi32(c[r][1], _mm512_unpackhi_epi16(lo, hi));
+        }
+    }
+    for (int r = 0; r < GEMM_MR; r++) {
+        uint32_t *row = C + (size_t)r * ldc;
+        if (accumulate) {
+            c[r][0] = _mm512_add_epi32(c[r][0], _mm512_loadu_si512((const void *)row));
+            c[r][1] = _mm512_add_epi32(c[r][1], _mm512_loadu_si512((const void *)(row + 16)));
+        }
+        _mm512_storeu_si512((void *)row, c[r][0]);
+        _mm512_storeu_si512((void *)(row + 16), c[r][1]);
+    }
+#elif defined(__AVX2__)
+    __m256i c[GEMM_MR][2];
+    for (int r = 0; r < GEMM_MR; r++) {
+        c[r][0] = _mm256_setzero_si256();
+        c[r][1] = _mm256_setzero_si256();
+    }
+    for (int k = 0; k < kc; k++) {
+        __m256i b = _mm256_load_si256((const __m256i *)(Bp + (size_t)k * GEMM_NR));
+        for (int r = 0; r < GEMM_MR; r++) {
+            __m256i a = _mm256_set1_epi16(Ap[k * GEMM_MR + r]);
+            __m256i lo = _mm256_mullo_epi16(a, b);
+            __m256i hi = _mm256_mulhi_epu16(a, b);
+            c[r][0] = _mm256_add_epi32(c[r][0], _mm256_unpacklo_epi16(lo, hi));
+            c[r][1] = _mm256_add_epi32(c[r][1], _mm256_unpackhi_epi16(lo, hi));
+        }
+    }
+    for (int r = 0; r < GEMM_MR; r++) {
+        uint32_t *row = C + (size_t)r * ldc;
+        if (accumulate) {
+            c[r][0] = _mm256_add_epi32(c[r][0], _mm256_loadu_si256((const __m256i *)row));
+            c[r][1] = _mm256_add_epi32(c[r][1], _mm256_loadu_si256((const __m256i *)(row + 8)));
+        }
+        _mm256_storeu_si256((__m256i *)row, c[r][0]);
+        _mm256_storeu_si256((__m256i *)(row + 8), c[r][1]);
+    }
+#else
+    uint32_t c[GEMM_MR][GEMM_NR] = {{0}};
+    for (int k = 0; k < kc; k++) {
+        for (int r = 0; r < GEMM_MR; r++) {
+            uint32_t a = Ap[k * GEMM_MR + r];
+            for (int p = 0; p < GEMM_NR; p++) {
+                c[r][p] += a * Bp[(size_t)k * GEMM_NR + p];
+            }
+        }
+    }
+    for (int r = 0; r < GEMM_MR; r++) {
+        for (int p = 0; p < GEMM_NR; p++) {
+            C[(size_t)r * ldc + p] = accumulate ? C[(size_t)r * ldc + p] + c[r][p] : c[r][p];
+        }
+    }
+#endif
+}
+
+/* Runs the microkernel on a possibly partial mr x nr tile */
+static void gemm_u16_tile(int kc, int mr, int nr, const uint16_t *Ap, const uint16_t *Bp,
+                          uint32_t *C, int ldc, int accumulate) {
+    if (mr == GEMM_MR && nr == GEMM_NR) {
+        gemm_u16_microkernel(kc, Ap, Bp, C, ldc, accumulate);
+        return;
+    }
+
+    uint32_t tile[GEMM_MR * GEMM_NR];
+    gemm_u16_microkernel(kc, Ap, Bp, tile, GEMM_NR, 0);
+    for (int r = 0; r < mr; r++) {
+        for (int p = 0; p < nr; p++) {
+            uint32_t *c = &C[(size_t)r * ldc + p];
+            *c = accumulate ? *c + tile[r * GEMM_NR + p] : tile[r * GEMM_NR + p];
+        }
+    }
+}
+
+/* Multiplies a packed mc x kc block of A with a packed kc x nc panel of B */
+static void gemm_u16_macrokernel(int mc, int nc, int kc, const uint16_t *Ap, const uint16_t *Bp,
+                                 uint32_t *C, int ldc, int accumulate) {
+    for (int jr = 0; jr < nc; jr += GEMM_NR) {
+        int nr = (nc - jr < GEMM_NR) ? nc - jr : GEMM_NR;
+        for (int ir = 0; ir < mc; ir += GEMM_MR) {
+            int mr = (mc - ir < GEMM_MR) ? mc - ir : GEMM_MR;
+            gemm_u16_tile(kc, mr, nr, Ap + (size_t)ir * kc, Bp + (size_t)jr * kc,
+                          &C[(size_t)ir * ldc + jr], ldc, accumulate);
+        }
+    }
+}
+
+/* Single-threaded C = A * B (or C += A * B when accumulate is set),
+ * also used as the base case of other drivers */
+static inline void gemm_u16_serial_acc(int M, int N, int K, const uint16_t *A, int lda,
+                                const uint16_t *B, int ldb, uint32_t *C, int ldc, int accumulate) {
+    int mc_max = gemm_round_up(gemm_u16_blocking.mc, GEMM_MR);
+    int kc_max = gemm_u16_blocking.kc;
+    int nc_max = gemm_round_up(gemm_u16_blocking.nc, GEMM_NR);
+
+    if (K == 0) {
+        if (!accumulate) {
+            for (int i = 0; i < M; i++) memset(&C[(size_t)i * ldc], 0, N * sizeof(uint32_t));
+        }
+        return;
+    }
+
+    uint16_t *Ap = gemm_scratch_get(&gemm_scratch_a, (size_t)mc_max * kc_max * sizeof(uint16_t));
+    uint16_t *Bp = gemm_scratch_get(&gemm_scratch_b, (size_t)kc_max * nc_max * sizeof(uint16_t));
+
+    for (int jc = 0; jc < N; jc += nc_max) {
+        int nc = (N - jc < nc_max) ? N - jc : nc_max;
+        for (int pc = 0; pc < K; pc += kc_max) {
+            int kc = (K - pc < kc_max) ? K - pc : kc_max;
+            for (int jr = 0; jr < nc; jr += GEMM_NR) {
+                gemm_u16_pack_b_sliver(kc, nc, jr, &B[(size_t)pc * ldb + jc], ldb, Bp + (size_t)jr * kc);
+            }
+            for (int ic = 0; ic < M; ic += mc_max) {
+                int mc = (M - ic < mc_max) ? M - ic : mc_max;
+                gemm_u16_pack_a(mc, kc, &A[(size_t)ic * lda + pc], lda, Ap);
+                gemm_u16_macrokernel(mc, nc, kc, Ap, Bp, &C[(size_t)ic * ldc + jc], ldc, accumulate || pc > 0);
+            }
+        }
+    }
+}
+
+static inline void gemm_u16_serial(int M, int N, int K, const uint16_t *A, int lda,
+                            const uint16_t *B, int ldb, uint32_t *C, int ldc) {
+    gemm_u16_serial_acc(M, N, K, A, lda, B, ldb, C, ldc, 0);
+}
+
+/* Parallel C = A * B using the current OpenMP thread count
+ * All threads pack the shared B panel together, then each thread packs its
+ * own A blocks and runs the macrokernel on them. */
+static inline void gemm_u16(int M, int N, int K, const uint16_t *A, int lda,
+                     const uint16_t *B, int ldb, uint32_t *C, int ldc) {
+    int threads = omp_get_max_threads();
+    int mc_max = gemm_round_up(gemm_u16_blocking.mc, GEMM_MR);
+    int kc_max = gemm_u16_blocking.kc;
+    int nc_max = gemm_round_up(gemm_u16_blocking.nc, GEMM_NR);
+
+    // Shrink the A blocks so that every thread gets at least one of them
+    int mc_share = gemm_round_up((M + threads - 1) / threads, GEMM_MR);
+    if (mc_share < mc_max) mc_max = mc_share;
+
+    if (threads == 1 || K == 0 || omp_in_parallel()) {
+        gemm_u16_serial(M, N, K, A, lda, B, ldb, C, ldc);
+        return;
+    }
+
+    uint16_t *Bp = gemm_alloc((size_t)kc_max * nc_max * sizeof(uint16_t));
+
+#pragma omp parallel shared(Bp)
+    {
+        uint16_t *Ap = gemm_alloc((size_t)mc_max * kc_max * sizeof(uint16_t));
+
+        for (int jc = 0; jc < N; jc += nc_max) {
+            int nc = (N - jc < nc_max) ? N - jc : nc_max;
+            for (int pc = 0; pc < K; pc += kc_max) {
+                int kc = (K - pc < kc_max) ? K - pc : kc_max;
+
+#pragma omp for schedule(static)
+                for (int jr = 0; jr < nc; jr += GEMM_NR) {
+                    gemm_u16_pack_b_sliver(kc, nc, jr, &B[(size_t)pc * ldb + jc], ldb, Bp + (size_t)jr * kc);
+                }
+
+#pragma omp for schedule(dynamic)
+                for (int ic = 0; ic < M; ic += mc_max) {
+                    int mc = (M - ic < mc_max) ? M - ic : mc_max;
+                    gemm_u16_pack_a(mc, kc, &A[(size_t)ic * lda + pc], lda, Ap);
+                    gemm_u16_macrokernel(mc, nc, kc, Ap, Bp, &C[(size_t)ic * ldc + jc], ldc, pc > 0);
+                }
+            }
+        }
+
+        free(Ap);
+    }
+
+    free(Bp);
+}
+
+#endif /* GEMM_U16_H */
@@ -0,0 +1,153 @@
+/* Contiguous 2-D grids
+ * grid_alloc() maps one region for a rows x cols grid of elem-byte
+ * elements instead of one malloc per row. Rows are padded to whole cache
+ * lines, plus one extra line when the stride is a multiple of 512 bytes
+ * (as the matmul strides are), so that walking down a column does not keep
+ * hitting the same cache sets. Element (i, j) is at
+ * data + (i * stride + j) * elem, see GRID_AT(); rows[] points to every row
+ * for code that indexes a[i][j]. The memory starts zeroed.
+ *
+ * GRID_PAGES picks the page size: small (default) uses plain pages, thp
+ * aligns the region to 2 MB and advises transparent huge pages, and huge
+ * maps it from the hugetlbfs pool (MAP_HUGETLB, falling back to thp when
+ * the pool is empty). Huge pages cut TLB misses on multi-GB grids on bare
+ * metal, but can be slower under virtualisation, so they are opt-in.
+ *
+ * GRID_NUMA places the pages: interleave spreads them over all nodes, local
+ * puts them on the node of the thread that touches them first, and by
+ * default the system policy applies (usually first touch too). A policy the
+ * kernel refuses is ignored; `pages` and `numa` record what was applied.
+ *
+ * Usage:
+ *     grid_arena g;
+ *     if (grid_alloc(&g, N, N, sizeof(int)) != 0) error;
+ *     int **a = (int **)g.rows;      // a[i][j]
+ *     GRID_AT(&g, int, i, j) = 1;    // the same element
+ *     grid_free(&g);
+*/
+
+#ifndef GRID_ALLOC_H
+#define GRID_ALLOC_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define GRID_LINE 64
+#define GRID_HUGE_PAGE (2UL << 20)
+#define GRID_MAX_NODES 1024
+
+/* Memory policies of set_mempolicy(2)/mbind(2) */
+#define GRID_MPOL_INTERLEAVE 3
+#define GRID_MPOL_LOCAL 4
+
+typedef struct {
+    char *data;       /* element (0, 0), 2 MB aligned when huge pages are used */
+    void **rows;      /* rows[i] = data + i * stride * elem */
+    size_t nrows, ncols, elem;
+    size_t stride;    /* elements per row, padded */
+    void *map;
+    size_t map_bytes;
+    const char *pages; /* "huge", "thp" or "small" */
+    const char *numa;  /* "interleave", "local" or "default" */
+} grid_arena;
+
+#define GRID_AT(g, type, i, j) (((type *)(g)->data)[(size_t)(i) * (g)->stride + (j)])
+
+static inline int grid_env_is(const char *name, const char *value) {
+    const char *v = getenv(name);
+    return v != NULL && strcmp(v, value) == 0;
+}
+
+/* Elements per row: whole cache lines, one more if it is a multiple of 512 bytes */
+static inline size_t grid_stride(size_t cols, size_t elem) {
+    size_t lines = (cols * elem + GRID_LINE - 1) / GRID_LINE;
+    if (lines % 8 == 0) lines++;
+    return lines * GRID_LINE / elem;
+}
+
+/* Maps `bytes` aligned to `align`, trimming the slack around the region */
+static inline void *grid_map_aligned(size_t bytes, size_t align) {
+    char *p = (char *)mmap(NULL, bytes + align, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) return NULL;
+    size_t head = (align - (size_t)p % align) % align;
+    if (head > 0) munmap(p, head);
+    if (align - head > 0) munmap(p + head + bytes, align - head);
+    return p + head;
+}
+
+/* Applies GRID_NUMA to the region; returns the policy that took effect */
+static inline const char *grid_place(void *p, size_t bytes) {
+    if (grid_env_is("GRID_NUMA", "interleave")) {
+        unsigned long mask[GRID_MAX_NODES / (8 * sizeof(unsigned long))] = {0};
+        int first = 0, last = 0, nodes = 0;
+        FILE *f = fopen("/sys/devices/system/node/online", "r");
+        // e.g. "0-3" or "0,2-3"
+        while (f != NULL && fscanf(f, "%d", &first) == 1) {
+            last = first;
+            int c = fgetc(f);
+            if (c == '-' && fscanf(f, "%d", &last) == 1) c = fgetc(f);
+            for (int n = first; n <= last && n < GRID_MAX_NODES; n++, nodes++) {
+                mask[n / (8 * sizeof(unsigned long))] |= 1UL << (n % (8 * sizeof(unsigned long)));
+            }
+            if (c != ',') break;
+        }
+        if (f != NULL) fclose(f);
+        if (nodes > 0 && syscall(SYS_mbind, p, bytes, GRID_MPOL_INTERLEAVE, mask, GRID_MAX_NODES, 0) == 0) {
+            return "interleave";
+        }
+    } else if (grid_env_is("GRID_NUMA", "local")) {
+        if (syscall(SYS_mbind, p, bytes, GRID_MPOL_LOCAL, NULL, 0, 0) == 0) return "local";
+    }
+    return "default";
+}
+
+static inline int grid_alloc(grid_arena *g, size_t rows, size_t cols, size_t elem) {
+    memset(g, 0, sizeof(*g));
+    g->nrows = rows;
+    g->ncols = cols;
+    g->elem = elem;
+    g->stride = grid_stride(cols, elem);
+
+    // Data first, so it starts on the (huge) page boundary, row pointers after it
+    size_t data_bytes = (rows * g->stride * elem + GRID_LINE - 1) / GRID_LINE * GRID_LINE;
+    size_t bytes = data_bytes + rows * sizeof(void *);
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    int huge = grid_env_is("GRID_PAGES", "huge");
+    int small = !(huge || grid_env_is("GRID_PAGES", "thp")) || bytes < GRID_HUGE_PAGE;
+
+    if (!small && huge) {
+        g->map_bytes = (bytes + GRID_HUGE_PAGE - 1) / GRID_HUGE_PAGE * GRID_HUGE_PAGE;
+        g->map = mmap(NULL, g->map_bytes, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (g->map == MAP_FAILED) g->map = NULL;
+        else g->pages = "huge";
+    }
+    if (g->map == NULL) {
+        g->map_bytes = (bytes + page - 1) / page * page;
+        g->map = grid_map_aligned(g->map_bytes, small ? page : GRID_HUGE_PAGE);
+        if (g->map == NULL) return -1;
+        g->pages = "small";
+#ifdef MADV_HUGEPAGE
+        if (!small && madvise(g->map, g->map_bytes, MADV_HUGEPAGE) == 0) g->pages = "thp";
+#endif
+    }
+    g->numa = grid_place(g->map, g->map_bytes);
+
+    g->data = (char *)g->map;
+    g->rows = (void **)(g->data + data_bytes);
+    for (size_t i = 0; i < rows; i++) {
+        g->rows[i] = g->data + i * g->stride * elem;
+    }
+    return 0;
+}
+
+static inline void grid_free(grid_arena *g) {
+    if (g->map != NULL) munmap(g->map, g->map_bytes);
+    memset(g, 0, sizeof(*g));
+}
+
+#endif /* GRID_ALLOC_H */
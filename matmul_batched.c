@@ -0,0 +1,107 @@
+/* Batched Small Matrix Multiplication using OpenMP
+ * Inputs: Number of threads, matrix size, number of products, optional seed
+ * Outputs: Execution time and throughput of the batched kernels, compared
+ *          with multiplying the products one by one with the outer loop
+ *          parallelized (as matmul_outer_parallel does)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <omp.h>
+#include "counter_rng.h"
+#include "matmul_batched.h"
+
+/* Multiplies the products one at a time, one parallel region each */
+static void matmul_one_by_one(const uint16_t *A, const uint16_t *B, uint32_t *C, int dim, int count) {
+    size_t size = (size_t)dim * dim;
+    for (int m = 0; m < count; m++) {
+        const uint16_t *a = A + m * size, *b = B + m * size;
+        uint32_t *c = C + m * size;
+
+        #pragma omp parallel for
+        for (int i = 0; i < dim; i++) {
+            for (int j = 0; j < dim; j++) {
+                uint32_t sum = 0;
+                for (int k = 0; k < dim; k++) {
+                    sum += (uint32_t)a[i * dim + k] * b[k * dim + j];
+                }
+                c[i * dim + j] = sum;
+            }
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 4 && argc != 5) {
+        printf("Usage: %s <num_threads> <matrix_size> <batch_count> [seed]\n", argv[0]);
+        return -1;
+    }
+
+    int num_threads = atoi(argv[1]);
+    int dim = atoi(argv[2]);
+    int count = atoi(argv[3]);
+    uint64_t seed = (argc == 5) ? strtoull(argv[4], NULL, 10) : 1;
+    if (num_threads < 1 || dim < 1 || count < 1) {
+        printf("Error: all arguments should be positive.\n");
+        return -1;
+    }
+    omp_set_num_threads(num_threads);
+
+    // The same products in plain row-major layout and in the interleaved batch layout
+    size_t size = (size_t)dim * dim;
+    uint16_t *A = malloc(count * size * sizeof(uint16_t));
+    uint16_t *B = malloc(count * size * sizeof(uint16_t));
+    uint32_t *C = malloc(count * size * sizeof(uint32_t));
+    matmul_batch batch = matmul_batch_alloc(dim, count);
+    for (int m = 0; m < count; m++) {
+        for (int i = 0; i < dim; i++) {
+            for (int j = 0; j < dim; j++) {
+                size_t e = m * size + i * dim + j;
+                A[e] = counter_rng(seed * 2, e);
+                B[e] = counter_rng(seed * 2 + 1, e);
+                batch.A[batch_index(&batch, m, i, j)] = A[e];
+                batch.B[batch_index(&batch, m, i, j)] = B[e];
+            }
+        }
+    }
+
+    double start_time, batched_time, single_time;
+
+    // Start the OpenMP threads before timing either method
+    #pragma omp parallel
+    {
+    }
+
+    start_time = omp_get_wtime();
+    matmul_batched(&batch);
+    batched_time = omp_get_wtime() - start_time;
+
+    start_time = omp_get_wtime();
+    matmul_one_by_one(A, B, C, dim, count);
+    single_time = omp_get_wtime() - start_time;
+
+    // Compare the results
+    long mismatches = 0;
+    for (int m = 0; m < count; m++) {
+        for (int i = 0; i < dim; i++) {
+            for (int j = 0; j < dim; j++) {
+                if (batch.C[batch_index(&batch, m, i, j)] != C[m * size + i * dim + j]) mismatches++;
+            }
+        }
+    }
+
+    double ops = 2.0 * dim * dim * dim * count;
+    printf("Batched %d products of %dx%d with %d threads: %f seconds, %.0f products/s, %.2f GOP/s\n",
+           count, dim, dim, num_threads, batched_time, count / batched_time, ops / batched_time * 1e-9);
+    printf("One by one %d products of %dx%d with %d threads: %f seconds, %.0f products/s, %.2f GOP/s\n",
+           count, dim, dim, num_threads, single_time, count / single_time, ops / single_time * 1e-9);
+    if (mismatches > 0) {
+        printf("Mismatch found in %ld entries between the batched and one by one results\n", mismatches);
+    }
+
+    free(A);
+    free(B);
+    free(C);
+    matmul_batch_free(&batch);
+    return 0;
+}
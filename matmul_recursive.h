@@ -0,0 +1,241 @@
+/* Task-parallel recursive matrix multiplication
+ * Cache-oblivious divide and conquer: the largest of M, N and K is halved
+ * until every dimension is at most base_cutoff, then the blocked GEMM from
+ * gemm_u16.h finishes the block. Splits of M and N run as OpenMP tasks on
+ * disjoint parts of C; splits of K run one after the other, the second half
+ * accumulating into C, so no two tasks ever update the same element.
+ *
+ * Above strassen_cutoff the product is first reduced with Strassen-Winograd
+ * (7 multiplications instead of 8 per level). The intermediate sums do not
+ * fit in 16 bits, so that path widens A and B to uint32 once; all arithmetic
+ * is modulo 2^32, where Strassen is exact.
+ *
+ * Call these from inside a parallel region (e.g. from an omp single block).
+ * matmul_recursive_ws() is the plain recursion on the work-stealing
+ * scheduler of ws_sched.h instead, using spawn/sync for the M and N splits.
+*/
+
+#ifndef MATMUL_RECURSIVE_H
+#define MATMUL_RECURSIVE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include "gemm_u16.h"
+#include "ws_sched.h"
+
+#define MATMUL_BASE_CUTOFF 256
+#define MATMUL_STRASSEN_CUTOFF 1024
+
+/* Single-threaded uint32 base kernel for the Strassen sub-products */
+static void gemm_u32_base(int M, int N, int K, const uint32_t *A, int lda,
+                          const uint32_t *B, int ldb, uint32_t *C, int ldc, int accumulate) {
+    for (int i = 0; i < M; i++) {
+        uint32_t *c = &C[(size_t)i * ldc];
+        if (!accumulate) memset(c, 0, N * sizeof(uint32_t));
+        for (int k = 0; k < K; k++) {
+            uint32_t a = A[(size_t)i * lda + k];
+            const uint32_t *b = &B[(size_t)k * ldb];
+            for (int j = 0; j < N; j++) {
+                c[j] += a * b[j];
+            }
+        }
+    }
+}
+
+/* Cache-oblivious recursion, generated for the uint16 and uint32 inputs */
+#define DEFINE_MATMUL_RECURSIVE(name, in_t, base)                                          \
+static void name(int M, int N, int K, const in_t *A, int lda, const in_t *B, int ldb,     \
+                 uint32_t *C, int ldc, int accumulate, int cutoff) {                      \
+    if (M <= cutoff && N <= cutoff && K <= cutoff) {                                       \
+        base(M, N, K, A, lda, B, ldb, C, ldc, accumulate);                                 \
+        return;                                                                            \
+    }                                                                                      \
+    if (M >= N && M >= K) {                                                                \
+        int h = M / 2;                                                                     \
+        _Pragma("omp task")                                                                \
+        name(h, N, K, A, lda, B, ldb, C, ldc, accumulate, cutoff);                         \
+        _Pragma("omp task")                                                                \
+        name(M - h, N, K, A + (size_t)h * lda, lda, B, ldb,                                \
+             C + (size_t)h * ldc, ldc, accumulate, cutoff);                                \
+        _Pragma("omp taskwait")                                                            \
+    } else if (N >= K) {                                                                   \
+        int h = N / 2;                                                                     \
+        _Pragma("omp task")                                                                \
+        name(M, h, K, A, lda, B, ldb, C, ldc, accumulate, cutoff);                         \
+        _Pragma("omp task")                                                                \
+        name(M, N - h, K, A, lda, B + h, ldb, C + h, ldc, accumulate, cutoff);             \
+        _Pragma("omp taskwait")                                                            \
+    } else {                                                                               \
+        int h = K / 2;                                                                     \
+        name(M, N, h, A, lda, B, ldb, C, ldc, accumulate, cutoff);                         \
+        name(M, N, K - h, A + h, lda, B + (size_t)h * ldb, ldb, C, ldc, 1, cutoff);        \
+    }                                                                                      \
+}
+
+DEFINE_MATMUL_RECURSIVE(matmul_recursive_u16, uint16_t, gemm_u16_serial_acc)
+DEFINE_MATMUL_RECURSIVE(matmul_recursive_u32, uint32_t, gemm_u32_base)
+
+/* Z = X + sign * Y for m x n blocks */
+static void matrix_add_u32(int m, int n, const uint32_t *X, int ldx, const uint32_t *Y, int ldy,
+                           int sign, uint32_t *Z, int ldz) {
+    for (int i = 0; i < m; i++) {
+        const uint32_t *x = &X[(size_t)i * ldx], *y = &Y[(size_t)i * ldy];
+        uint32_t *z = &Z[(size_t)i * ldz];
+        if (sign > 0) {
+            for (int j = 0; j < n; j++) z[j] = x[j] + y[j];
+        } else {
+            for (int j = 0; j < n; j++) z[j] = x[j] - y[j];
+        }
+    }
+}
+
+/* Strassen-Winograd on uint32 blocks whose dimensions are divisible by 2^levels */
+static void matmul_strassen_u32(int M, int N, int K, const uint32_t *A, int lda,
+                                const uint32_t *B, int ldb, uint32_t *C, int ldc,
+                                int levels, int cutoff) {
+    if (levels == 0) {
+        matmul_recursive_u32(M, N, K, A, lda, B, ldb, C, ldc, 0, cutoff);
+        return;
+    }
+
+    int m = M / 2, n = N / 2, k = K / 2;
+    const uint32_t *A11 = A, *A12 = A + k, *A21 = A + (size_t)m * lda, *A22 = A21 + k;
+    const uint32_t *B11 = B, *B12 = B + n, *B21 = B + (size_t)k * ldb, *B22 = B21 + n;
+    uint32_t *C11 = C, *C12 = C + n, *C21 = C + (size_t)m * ldc, *C22 = C21 + n;
+
+    size_t a_size = (size_t)m * k, b_size = (size_t)k * n, c_size = (size_t)m * n;
+    uint32_t *S = gemm_alloc(4 * a_size * sizeof(uint32_t));
+    uint32_t *T = gemm_alloc(4 * b_size * sizeof(uint32_t));
+    uint32_t *P = gemm_alloc(7 * c_size * sizeof(uint32_t));
+    uint32_t *S1 = S, *S2 = S + a_size, *S3 = S + 2 * a_size, *S4 = S + 3 * a_size;
+    uint32_t *T1 = T, *T2 = T + b_size, *T3 = T + 2 * b_size, *T4 = T + 3 * b_size;
+    uint32_t *Pi[7];
+    for (int i = 0; i < 7; i++) Pi[i] = P + i * c_size;
+
+    matrix_add_u32(m, k, A21, lda, A22, lda, 1, S1, k);
+    matrix_add_u32(m, k, S1, k, A11, lda, -1, S2, k);
+    matrix_add_u32(m, k, A11, lda, A21, lda, -1, S3, k);
+    matrix_add_u32(m, k, A12, lda, S2, k, -1, S4, k);
+    matrix_add_u32(k, n, B12, ldb, B11, ldb, -1, T1, n);
+    matrix_add_u32(k, n, B22, ldb, T1, n, -1, T2, n);
+    matrix_add_u32(k, n, B22, ldb, B12, ldb, -1, T3, n);
+    matrix_add_u32(k, n, T2, n, B21, ldb, -1, T4, n);
+
+    const uint32_t *left[7] = { A11, A12, S4, A22, S1, S2, S3 };
+    const int left_ld[7] = { lda, lda, k, lda, k, k, k };
+    const uint32_t *right[7] = { B11, B21, B22, T4, T1, T2, T3 };
+    const int right_ld[7] = { ldb, ldb, ldb, n, n, n, n };
+    for (int i = 0; i < 7; i++) {
+        #pragma omp task firstprivate(i)
+        matmul_strassen_u32(m, n, k, left[i], left_ld[i], right[i], right_ld[i], Pi[i], n, levels - 1, cutoff);
+    }
+    #pragma omp taskwait
+
+    // U2 = P1 + P6, U3 = U2 + P7, U4 = U2 + P5
+    matrix_add_u32(m, n, Pi[0], n, Pi[1], n, 1, C11, ldc);
+    matrix_add_u32(m, n, Pi[0], n, Pi[5], n, 1, Pi[5], n);
+    matrix_add_u32(m, n, Pi[5], n, Pi[6], n, 1, Pi[6], n);
+    matrix_add_u32(m, n, Pi[5], n, Pi[4], n, 1, Pi[5], n);
+    matrix_add_u32(m, n, Pi[5], n, Pi[2], n, 1, C12, ldc);
+    matrix_add_u32(m, n, Pi[6], n, Pi[3], n, -1, C21, ldc);
+    matrix_add_u32(m, n, Pi[6], n, Pi[4], n, 1, C22, ldc);
+
+    free(S);
+    free(T);
+    free(P);
+}
+
+/* C = A * B with Strassen-Winograd levels while every dimension stays at or
+ * above strassen_cutoff, then the cache-oblivious recursion */
+static inline void matmul_strassen(int M, int N, int K, const uint16_t *A, int lda,
+                            const uint16_t *B, int ldb, uint32_t *C, int ldc,
+                            int strassen_cutoff, int base_cutoff) {
+    int levels = 0;
+    while (strassen_cutoff > 0 && (M >> levels) >= strassen_cutoff &&
+           (N >> levels) >= strassen_cutoff && (K >> levels) >= strassen_cutoff) {
+        levels++;
+    }
+    if (levels == 0) {
+        matmul_recursive_u16(M, N, K, A, lda, B, ldb, C, ldc, 0, base_cutoff);
+        return;
+    }
+
+    // Widen into zero padded copies whose dimensions divide by 2^levels
+    int Mp = gemm_round_up(M, 1 << levels), Np = gemm_round_up(N, 1 << levels);
+    int Kp = gemm_round_up(K, 1 << levels);
+    uint32_t *Aw = gemm_alloc((size_t)Mp * Kp * sizeof(uint32_t));
+    uint32_t *Bw = gemm_alloc((size_t)Kp * Np * sizeof(uint32_t));
+    uint32_t *Cw = gemm_alloc((size_t)Mp * Np * sizeof(uint32_t));
+
+    #pragma omp taskloop
+    for (int i = 0; i < Mp; i++) {
+        for (int j = 0; j < Kp; j++) {
+            Aw[(size_t)i * Kp + j] = (i < M && j < K) ? A[(size_t)i * lda + j] : 0;
+        }
+    }
+    #pragma omp taskloop
+    for (int i = 0; i < Kp; i++) {
+        for (int j = 0; j < Np; j++) {
+            Bw[(size_t)i * Np + j] = (i < K && j < N) ? B[(size_t)i * ldb + j] : 0;
+        }
+    }
+
+    matmul_strassen_u32(Mp, Np, Kp, Aw, Kp, Bw, Np, Cw, Np, levels, base_cutoff);
+
+    #pragma omp taskloop
+    for (int i = 0; i < M; i++) {
+        memcpy(&C[(size_t)i * ldc], &Cw[(size_t)i * Np], N * sizeof(uint32_t));
+    }
+
+    free(Aw);
+    free(Bw);
+    free(Cw);
+}
+
+/* One block of the recursion on the work-stealing scheduler */
+typedef struct {
+    int M, N, K;
+    const uint16_t *A, *B;
+    uint32_t *C;
+    int lda, ldb, ldc;
+    int accumulate, cutoff;
+} matmul_ws_block;
+
+static void matmul_recursive_ws(void *arg) {
+    matmul_ws_block *b = (matmul_ws_block *)arg;
+    if (b->M <= b->cutoff && b->N <= b->cutoff && b->K <= b->cutoff) {
+        gemm_u16_serial_acc(b->M, b->N, b->K, b->A, b->lda, b->B, b->ldb, b->C, b->ldc, b->accumulate);
+        return;
+    }
+    matmul_ws_block first = *b, second = *b;
+    ws_group g = WS_GROUP_INIT;
+    if (b->M >= b->N && b->M >= b->K) {
+        first.M = b->M / 2;
+        second.M = b->M - first.M;
+        second.A += (size_t)first.M * b->lda;
+        second.C += (size_t)first.M * b->ldc;
+        ws_spawn(&g, matmul_recursive_ws, &first);
+        matmul_recursive_ws(&second);
+        ws_sync(&g);
+    } else if (b->N >= b->K) {
+        first.N = b->N / 2;
+        second.N = b->N - first.N;
+        second.B += first.N;
+        second.C += first.N;
+        ws_spawn(&g, matmul_recursive_ws, &first);
+        matmul_recursive_ws(&second);
+        ws_sync(&g);
+    } else {
+        first.K = b->K / 2;
+        second.K = b->K - first.K;
+        second.A += first.K;
+        second.B += (size_t)first.K * b->ldb;
+        second.accumulate = 1;
+        matmul_recursive_ws(&first);
+        matmul_recursive_ws(&second);
+    }
+}
+
+#endif /* MATMUL_RECURSIVE_H */
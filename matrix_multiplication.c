@@ -1,113 +1,461 @@
 /* Parallelized Matrix Multiplication using OpenMP
- * Inputs: Number of threads, Number of loops to parallelize
+ * Inputs: Number of threads, Number of loops to parallelize, optional seed,
+ *         optional dimensions (N for square, or M K N)
  * Outputs: Execution time and result array
+ *
+ * Variant 4 uses the blocked SIMD GEMM from gemm_u16.h; compile with
+ * -march=native (or -mavx2 / -mavx512bw) to enable its vector microkernel.
+ * Variants 5 and 6 use the task-parallel recursion from matmul_recursive.h,
+ * without and with Strassen-Winograd; the environment variables
+ * MATMUL_BASE_CUTOFF and MATMUL_STRASSEN_CUTOFF tune their cutoffs.
+ *
+ * Variant 0 autotunes the blocked and recursive kernels for the given shape
+ * and stores the winning variant, thread count, block sizes and cutoff in the
+ * tuning file (see tuning.h). Variant -1 runs the tuned variant of the shape
+ * with those settings; running that variant by number loads them too, and
+ * num_threads = 0 selects the tuned thread count. Other variants ignore them.
+ *
+ * PERF_REGIONS=1 (or threads) reports hardware counters of the timed runs,
+ * see perf_region.h. SCHEDULER=ws runs variants 1, 2 and 5 on the
+ * work-stealing scheduler of ws_sched.h instead of OpenMP.
 */
 
 #include<stdio.h>
 #include<omp.h>
 #include<stdlib.h>
+#include "bench.h"
+#include "counter_rng.h"
+#include "gemm_u16.h"
+#include "matmul_recursive.h"
+#include "perf_region.h"
+#include "tuning.h"
+#include "ws_sched.h"
 
-#define DIM 1000 /* Size of matrix */
-
-/* Global variables */
-int num_threads;
-__uint16_t A[DIM][DIM];
-__uint16_t B[DIM][DIM];
-__uint32_t C[DIM][DIM];
-
-/* Initialize matricies */
-void initialize_matricies() {
-    for (int i = 0; i < DIM; i++) {
-        for (int j = 0; j < DIM; j++) {
-            A[i][j] = rand();
-            B[i][j] = rand();
-            C[i][j] = 0;
+#define DIM 1000 /* Default size of matrix */
+#define TUNE_REPS 3 /* Timed runs per autotuning candidate, best one counts */
+
+/* Row strides are padded to whole cache lines so every row starts aligned,
+ * plus one extra line when the stride is a multiple of 512 bytes, so that
+ * walking down a column does not keep hitting the same cache sets */
+#define ALIGNMENT 64
+#define PAD_LD(n, per_line) \
+    (((n) + (per_line) - 1) / (per_line) * (per_line) + \
+     (((n) + (per_line) - 1) / (per_line) % 8 == 0 ? (per_line) : 0))
+#define LD_U16(n) PAD_LD(n, 32)
+#define LD_U32(n) PAD_LD(n, 16)
+
+/* C (M x N) = A (M x K) * B (K x N), stored row-major with padded strides */
+typedef struct {
+    int M, K, N;
+    int lda, ldb, ldc;
+    __uint16_t *A;
+    __uint16_t *B;
+    __uint32_t *C;
+} matmul_problem;
+
+static void *alloc_aligned(size_t bytes) {
+    return aligned_alloc(ALIGNMENT, (bytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT);
+}
+
+/* Allocate the padded, aligned matricies for an M x K x N product */
+void allocate_matricies(matmul_problem *p, int M, int K, int N) {
+    p->M = M;
+    p->K = K;
+    p->N = N;
+    p->lda = LD_U16(K);
+    p->ldb = LD_U16(N);
+    p->ldc = LD_U32(N);
+    p->A = alloc_aligned((size_t)M * p->lda * sizeof(__uint16_t));
+    p->B = alloc_aligned((size_t)K * p->ldb * sizeof(__uint16_t));
+    p->C = alloc_aligned((size_t)M * p->ldc * sizeof(__uint32_t));
+}
+
+void free_matricies(matmul_problem *p) {
+    free(p->A);
+    free(p->B);
+    free(p->C);
+}
+
+/* Initialize matricies
+ * Rows are distributed with the same static schedule as the kernels, so each
+ * page is first touched by the thread (and NUMA node) that later computes on it.
+ * Values come from a counter-based RNG and do not depend on the thread count.
+*/
+void initialize_matricies(matmul_problem *p, uint64_t seed) {
+    uint64_t seed_a = seed * 2, seed_b = seed * 2 + 1;
+    int rows = (p->M > p->K) ? p->M : p->K;
+
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < rows; i++) {
+        if (i < p->M) {
+            for (int k = 0; k < p->K; k++) {
+                p->A[(size_t)i * p->lda + k] = counter_rng(seed_a, (uint64_t)i * p->K + k);
+            }
+            for (int j = 0; j < p->N; j++) {
+                p->C[(size_t)i * p->ldc + j] = 0;
+            }
+        }
+        if (i < p->K) {
+            for (int j = 0; j < p->N; j++) {
+                p->B[(size_t)i * p->ldb + j] = counter_rng(seed_b, (uint64_t)i * p->N + j);
+            }
         }
     }
 }
 
+/* Naive ijk loop nest shared by the runtime-sized and fixed-size kernels,
+ * accumulating in a local sum, so the two differ only in how their bounds
+ * and strides are known */
+#define MATMUL_LOOP_NEST(M, K, N) \
+    for (i = 0; i < (M); i++) { \
+        for (j = 0; j < (N); j++) { \
+            __uint32_t sum = 0; \
+            for (k = 0; k < (K); k++) { \
+                sum += A[i][k] * B[k][j]; \
+            } \
+            C[i][j] = sum; \
+        } \
+    }
+
+/* The same nest with nothing between the loops, as collapse(3) requires */
+#define MATMUL_PERFECT_LOOP_NEST(M, K, N) \
+    for (i = 0; i < (M); i++) { \
+        for (j = 0; j < (N); j++) { \
+            for (k = 0; k < (K); k++) { \
+                if (k == 0) C[i][j] = 0; \
+                C[i][j] += A[i][k] * B[k][j]; \
+            } \
+        } \
+    }
+
+/* 2-D views of the problem's matricies, so kernels can index A[i][k] */
+#define MATMUL_VIEWS(p, lda, ldb, ldc) \
+    __uint16_t (*A)[lda] = (void *)(p)->A; \
+    __uint16_t (*B)[ldb] = (void *)(p)->B; \
+    __uint32_t (*C)[ldc] = (void *)(p)->C
+
 // Function to perform matrix multiplication with outer loop parallelized
-void matmul_outer_parallel(__uint16_t A[DIM][DIM], __uint16_t B[DIM][DIM], __uint32_t C[DIM][DIM], int num_threads) {
+void matmul_outer_parallel(matmul_problem *p, int num_threads) {
     int i, j, k;
+    MATMUL_VIEWS(p, p->lda, p->ldb, p->ldc);
     omp_set_num_threads(num_threads);
 
 #pragma omp parallel for private(i, j, k) shared(A, B, C)
-    for (i = 0; i < DIM; i++) {
-        for (j = 0; j < DIM; j++) {
-            for (k = 0; k < DIM; k++) {
-                if (k == 0) C[i][j] = 0;
-                C[i][j] += A[i][k] * B[k][j];
-            }
-        }
-    }
+    MATMUL_LOOP_NEST(p->M, p->K, p->N)
 }
 
 // Function to perform matrix multiplication with outer and middle loops parallelized
-void matmul_outer_middle_parallel(__uint16_t A[DIM][DIM], __uint16_t B[DIM][DIM], __uint32_t C[DIM][DIM], int num_threads) {
+void matmul_outer_middle_parallel(matmul_problem *p, int num_threads) {
     int i, j, k;
+    MATMUL_VIEWS(p, p->lda, p->ldb, p->ldc);
     omp_set_num_threads(num_threads);
 
 #pragma omp parallel for collapse(2) private(i, j, k) shared(A, B, C)
-    for (i = 0; i < DIM; i++) {
-        for (j = 0; j < DIM; j++) {
-            for (k = 0; k < DIM; k++) {
-                if (k == 0) C[i][j] = 0;
-                C[i][j] += A[i][k] * B[k][j];
-            }
-        }
-    }
+    MATMUL_LOOP_NEST(p->M, p->K, p->N)
 }
 
 // Function to perform matrix multiplication with all loops parallelized
-void matmul_outer_middle_inner_parallel(__uint16_t A[DIM][DIM], __uint16_t B[DIM][DIM], __uint32_t C[DIM][DIM], int num_threads) {
+void matmul_outer_middle_inner_parallel(matmul_problem *p, int num_threads) {
     int i, j, k;
+    MATMUL_VIEWS(p, p->lda, p->ldb, p->ldc);
     omp_set_num_threads(num_threads);
 
 #pragma omp parallel for collapse(3) private(i, j, k) shared(A, B, C)
-    for (i = 0; i < DIM; i++) {
-        for (j = 0; j < DIM; j++) {
-            for (k = 0; k < DIM; k++) {
-                if (k == 0) C[i][j] = 0;
-                C[i][j] += A[i][k] * B[k][j];
+    MATMUL_PERFECT_LOOP_NEST(p->M, p->K, p->N)
+}
+
+// Function to perform matrix multiplication with the cache-blocked SIMD GEMM engine
+void matmul_blocked_simd(matmul_problem *p, int num_threads) {
+    omp_set_num_threads(num_threads);
+    gemm_u16(p->M, p->N, p->K, p->A, p->lda, p->B, p->ldb, p->C, p->ldc);
+}
+
+/* Work-stealing versions of the outer and outer+middle parallel variants,
+ * over ranges of rows and of (row, column) cells */
+static void matmul_ws_rows(long begin, long end, void *arg) {
+    matmul_problem *p = arg;
+    MATMUL_VIEWS(p, p->lda, p->ldb, p->ldc);
+    for (long i = begin; i < end; i++) {
+        for (int j = 0; j < p->N; j++) {
+            __uint32_t sum = 0;
+            for (int k = 0; k < p->K; k++) {
+                sum += A[i][k] * B[k][j];
             }
+            C[i][j] = sum;
         }
     }
 }
 
+static void matmul_ws_cells(long begin, long end, void *arg) {
+    matmul_problem *p = arg;
+    MATMUL_VIEWS(p, p->lda, p->ldb, p->ldc);
+    for (long cell = begin; cell < end; cell++) {
+        long i = cell / p->N, j = cell % p->N;
+        __uint32_t sum = 0;
+        for (int k = 0; k < p->K; k++) {
+            sum += A[i][k] * B[k][j];
+        }
+        C[i][j] = sum;
+    }
+}
+
+/* Reads a positive integer setting from the environment */
+static int env_int(const char *name, int fallback) {
+    const char *value = getenv(name);
+    return (value != NULL && atoi(value) > 0) ? atoi(value) : fallback;
+}
+
+/* Cutoffs of the recursive variants (tuning file, then environment) */
+int base_cutoff = MATMUL_BASE_CUTOFF;
+int strassen_cutoff = MATMUL_STRASSEN_CUTOFF;
+
+// Function to perform matrix multiplication with cache-oblivious recursive tasks
+void matmul_recursive(matmul_problem *p, int num_threads, int use_strassen) {
+    if (ws_active() && !use_strassen) {
+        matmul_ws_block root = {p->M, p->N, p->K, p->A, p->B, p->C, p->lda, p->ldb, p->ldc, 0, base_cutoff};
+        matmul_recursive_ws(&root);
+        return;
+    }
+    omp_set_num_threads(num_threads);
+
+#pragma omp parallel
+#pragma omp single
+    matmul_strassen(p->M, p->N, p->K, p->A, p->lda, p->B, p->ldb, p->C, p->ldc,
+                    use_strassen ? strassen_cutoff : 0, base_cutoff);
+}
+
+/* Fixed-size square kernels
+ * Outer and outer+middle parallel variants with compile-time bounds and
+ * strides, on the same loop nest as the runtime-sized ones. The constant
+ * trip counts and strides spare the index arithmetic and remainder checks,
+ * and let the compiler vectorize the K loop as a reduction; at
+ * D = 256..1024 the loops are not unrolled fully. Used when M = K = N = D.
+ * The collapse(3) variant has no race-free fixed-size form and always takes
+ * the runtime-sized path.
+*/
+#define DEFINE_FIXED_MATMUL(D) \
+static void matmul_fixed_##D(matmul_problem *p, int loops_to_parallelize) { \
+    int i, j, k; \
+    MATMUL_VIEWS(p, LD_U16(D), LD_U16(D), LD_U32(D)); \
+    if (loops_to_parallelize == 1) { \
+        _Pragma("omp parallel for private(i, j, k) shared(A, B, C)") \
+        MATMUL_LOOP_NEST(D, D, D) \
+    } else { \
+        _Pragma("omp parallel for collapse(2) private(i, j, k) shared(A, B, C)") \
+        MATMUL_LOOP_NEST(D, D, D) \
+    } \
+}
+
+DEFINE_FIXED_MATMUL(256)
+DEFINE_FIXED_MATMUL(512)
+DEFINE_FIXED_MATMUL(1000)
+DEFINE_FIXED_MATMUL(1024)
+
+/* Returns the fixed-size kernel for the problem's shape, or NULL */
+static void (*fixed_kernel(matmul_problem *p))(matmul_problem *, int) {
+    if (p->M != p->K || p->K != p->N) return NULL;
+    switch (p->M) {
+        case 256: return matmul_fixed_256;
+        case 512: return matmul_fixed_512;
+        case 1000: return matmul_fixed_1000;
+        case 1024: return matmul_fixed_1024;
+        default: return NULL;
+    }
+}
+
+/* Runs one variant; returns 1 if a fixed-size kernel was used */
+static int run_variant(matmul_problem *p, int variant, int num_threads) {
+    // Common square sizes run on kernels specialised at compile time
+    void (*fixed)(matmul_problem *, int) = (variant <= 2 && !ws_active()) ? fixed_kernel(p) : NULL;
+
+    if (ws_active() && variant == 1) {
+        ws_parallel_for(0, p->M, 1, matmul_ws_rows, p);
+    } else if (ws_active() && variant == 2) {
+        ws_parallel_for(0, (long)p->M * p->N, 0, matmul_ws_cells, p);
+    } else if (fixed != NULL) {
+        omp_set_num_threads(num_threads);
+        fixed(p, variant);
+    } else if (variant == 1) {
+        matmul_outer_parallel(p, num_threads);
+    } else if (variant == 2) {
+        matmul_outer_middle_parallel(p, num_threads);
+    } else if (variant == 3) {
+        matmul_outer_middle_inner_parallel(p, num_threads);
+    } else if (variant == 4) {
+        matmul_blocked_simd(p, num_threads);
+    } else {
+        matmul_recursive(p, num_threads, variant == 6);
+    }
+    return fixed != NULL;
+}
+
+/* Best time out of TUNE_REPS runs with the current settings */
+static double time_variant(matmul_problem *p, int variant, int num_threads) {
+    double best = 0;
+    for (int r = 0; r < TUNE_REPS; r++) {
+        double start_time = bench_now();
+        run_variant(p, variant, num_threads);
+        double elapsed = bench_now() - start_time;
+        if (r == 0 || elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+/* Searches thread counts, block sizes and the recursion cutoff for this shape
+ * (one parameter at a time, keeping the best so far) and stores the winners */
+void autotune(matmul_problem *p, int max_threads) {
+    static const int mc_values[] = {48, 96, 120, 192, 240};
+    static const int kc_values[] = {128, 192, 256, 384, 512};
+    static const int nc_values[] = {1024, 2048, 4096, 8192};
+    static const int cutoff_values[] = {64, 128, 256, 512};
+    int best_variant = 4, best_threads = max_threads;
+    double best_time = -1, t;
+
+    // Variant and thread count: powers of two up to max_threads, plus max_threads
+    for (int variant = 4; variant <= 5; variant++) {
+        for (int threads = 1; ; threads = (threads * 2 < max_threads) ? threads * 2 : max_threads) {
+            t = time_variant(p, variant, threads);
+            if (best_time < 0 || t < best_time) {
+                best_time = t;
+                best_variant = variant;
+                best_threads = threads;
+            }
+            if (threads == max_threads) break;
+        }
+    }
+
+    // Block sizes of the GEMM engine, which both variants use
+    #define TUNE_PARAM(var, values) \
+        for (size_t v = 0; v < sizeof(values) / sizeof(values[0]); v++) { \
+            int previous = var; \
+            var = values[v]; \
+            t = time_variant(p, best_variant, best_threads); \
+            if (t < best_time) best_time = t; else var = previous; \
+        }
+    TUNE_PARAM(gemm_u16_blocking.mc, mc_values)
+    TUNE_PARAM(gemm_u16_blocking.kc, kc_values)
+    TUNE_PARAM(gemm_u16_blocking.nc, nc_values)
+    if (best_variant == 5) {
+        TUNE_PARAM(base_cutoff, cutoff_values)
+    }
+    #undef TUNE_PARAM
+
+    char shape[64], params[TUNING_LINE];
+    snprintf(shape, sizeof(shape), "%dx%dx%d", p->M, p->K, p->N);
+    snprintf(params, sizeof(params), "variant=%d threads=%d mc=%d kc=%d nc=%d base_cutoff=%d time_us=%d",
+             best_variant, best_threads, gemm_u16_blocking.mc, gemm_u16_blocking.kc,
+             gemm_u16_blocking.nc, base_cutoff, (int)(best_time * 1e6));
+    if (tuning_store("matmul", shape, params) != 0) {
+        printf("Error: could not write the tuning file %s\n", tuning_path());
+    }
+    printf("Tuned %s: %s\n", shape, params);
+}
+
+/* Applies the stored settings for this shape if they were tuned for *variant,
+ * or for any variant when *variant is -1, which becomes the tuned one.
+ * Returns the tuned thread count, or 0 if nothing was applied. */
+static int load_tuning(matmul_problem *p, int *variant) {
+    char shape[64], params[TUNING_LINE];
+    snprintf(shape, sizeof(shape), "%dx%dx%d", p->M, p->K, p->N);
+    if (!tuning_load("matmul", shape, params, sizeof(params))) return 0;
+    int tuned = tuning_get(params, "variant", 0);
+    if (tuned < 1 || (*variant > 0 && *variant != tuned)) return 0;
+    *variant = tuned;
+
+    gemm_u16_blocking.mc = tuning_get(params, "mc", gemm_u16_blocking.mc);
+    gemm_u16_blocking.kc = tuning_get(params, "kc", gemm_u16_blocking.kc);
+    gemm_u16_blocking.nc = tuning_get(params, "nc", gemm_u16_blocking.nc);
+    base_cutoff = tuning_get(params, "base_cutoff", base_cutoff);
+    return tuning_get(params, "threads", 0);
+}
+
 int main(int argc, char* argv[]) {
-    if (argc != 3) {
-        printf("Usage: %s <num_threads> <loops_to_parallelize (1, 2, or 3)>\n", argv[0]);
+    if (argc != 3 && argc != 4 && argc != 5 && argc != 7) {
+        printf("Usage: %s <num_threads (0 = tuned)> <loops_to_parallelize (1, 2, 3; 4 blocked SIMD; 5 recursive; 6 recursive Strassen; 0 autotune; -1 tuned)> [seed [N | M K N]]\n", argv[0]);
         return -1;
     }
 
     int num_threads = atoi(argv[1]);
     int loops_to_parallelize = atoi(argv[2]);
+    uint64_t seed = (argc >= 4) ? strtoull(argv[3], NULL, 10) : 1;
+    int M = DIM, K = DIM, N = DIM;
+    if (argc == 5) {
+        M = K = N = atoi(argv[4]);
+    } else if (argc == 7) {
+        M = atoi(argv[4]);
+        K = atoi(argv[5]);
+        N = atoi(argv[6]);
+    }
 
-    if (loops_to_parallelize < 1 || loops_to_parallelize > 3) {
-        printf("Error: loops_to_parallelize should be 1, 2, or 3.\n");
+    if (loops_to_parallelize < -1 || loops_to_parallelize > 6) {
+        printf("Error: loops_to_parallelize should be between -1 and 6.\n");
+        return -1;
+    }
+    if (M < 1 || K < 1 || N < 1) {
+        printf("Error: matrix dimensions should be positive.\n");
         return -1;
     }
 
-    // Initialize A, B and C matricies
-    initialize_matricies();
+    matmul_problem problem;
+    allocate_matricies(&problem, M, K, N);
 
-    double start_time, end_time;
+    // Stored settings for this shape first, explicit environment settings override them
+    int tuned_threads = (loops_to_parallelize != 0) ? load_tuning(&problem, &loops_to_parallelize) : 0;
+    if (loops_to_parallelize < 0) {
+        printf("No tuning for %dx%dx%d in %s, running variant 4; run variant 0 to tune it\n", M, K, N, tuning_path());
+        loops_to_parallelize = 4;
+    }
+    base_cutoff = env_int("MATMUL_BASE_CUTOFF", base_cutoff);
+    strassen_cutoff = env_int("MATMUL_STRASSEN_CUTOFF", strassen_cutoff);
+    if (num_threads < 1) {
+        num_threads = (tuned_threads > 0) ? tuned_threads : omp_get_num_procs();
+    }
 
-    // Start timing here
-    start_time = omp_get_wtime();
+    // Initialize A, B and C matricies with the threads that will use them
+    omp_set_num_threads(num_threads);
+    initialize_matricies(&problem, seed);
 
-    // Call the appropriate function based on loops_to_parallelize
-    if (loops_to_parallelize == 1) {
-        matmul_outer_parallel(A, B, C, num_threads);
-    } else if (loops_to_parallelize == 2) {
-        matmul_outer_middle_parallel(A, B, C, num_threads);
-    } else {
-        matmul_outer_middle_inner_parallel(A, B, C, num_threads);
+    if (loops_to_parallelize == 0) {
+        autotune(&problem, num_threads);
+        free_matricies(&problem);
+        return 0;
+    }
+
+    bench_config cfg = bench_config_get();
+    double *times = bench_times(&cfg);
+    int fixed = 0;
+    char region_name[64];
+    perf_region region;
+    snprintf(region_name, sizeof(region_name), "matmul variant=%d", loops_to_parallelize);
+    perf_region_init(&region, region_name);
+    int ws = ws_requested();
+    if (ws) ws_start(num_threads);
+    for (int rep = -cfg.warmups; rep < cfg.reps; rep++) {
+        // Start timing here
+        double start_time = bench_now();
+
+        // Call the appropriate function based on loops_to_parallelize
+        perf_region_begin(&region);
+        fixed = run_variant(&problem, loops_to_parallelize, num_threads);
+        perf_region_end(&region);
+
+        // End timing here
+        bench_record(times, rep, bench_now() - start_time);
     }
+    perf_region_report(&region, (double)M * N, "element", 2.0 * M * K * N);
+    perf_region_close(&region);
+    ws_stop();
+
+    char params[128];
+    snprintf(params, sizeof(params), "M=%d,K=%d,N=%d,threads=%d,variant=%d,scheduler=%s",
+             M, K, N, num_threads, loops_to_parallelize, ws ? "ws" : "openmp");
+    bench_stats stats = bench_report("matrix_multiplication", params, times, cfg.reps, 2.0 * M * K * N * 1e-9, "GOP/s");
 
-    // End timing here
-    end_time = omp_get_wtime();
-    
     // Print execution time
-    printf("Execution time with %d threads and %d loops parallelized: %f seconds\n", num_threads, loops_to_parallelize, end_time - start_time);
+    printf("Execution time for %dx%dx%d%s with %d threads and %d loops parallelized: %f seconds\n",
+           M, K, N, fixed ? " (fixed-size kernel)" : "", num_threads, loops_to_parallelize, stats.median);
+
+    free(times);
+    free_matricies(&problem);
+    return 0;
 }
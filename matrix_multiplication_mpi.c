@@ -0,0 +1,225 @@
+/* Distributed Matrix Multiplication using MPI (SUMMA)
+ * Inputs: N for a square problem, or M K N; optional seed
+ * Outputs: Execution time, per-rank compute and communication time
+ *
+ * The ranks form a 2-D grid and each one owns a block of A, B and C. For
+ * every panel of K, the owners broadcast their part of the A panel along
+ * the grid row and of the B panel along the grid column, and every rank
+ * adds the product of the two panels to its block of C. The broadcast of
+ * the next panel is posted before the current one is multiplied, so
+ * communication overlaps the local GEMM.
+ *
+ * Every rank generates its own blocks with the same counter-based RNG as
+ * matrix_multiplication.c, so no input has to be scattered.
+ *
+ * Run with e.g.: mpirun -np 4 ./matrix_multiplication_mpi 2000
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+#include "counter_rng.h"
+#include "gemm_u16.h"
+
+#define PANEL_WIDTH 256 /* Columns of A / rows of B broadcast per step */
+#define CHECKS_PER_RANK 16 /* Entries of C verified on each rank */
+
+/* First index owned by part r when n items are split into p parts */
+static int block_start(int n, int p, int r) {
+    return r * (n / p) + ((r < n % p) ? r : n % p);
+}
+
+/* Grid coordinate that owns index i when n items are split into p parts */
+static int block_owner(int n, int p, int i) {
+    int r = 0;
+    while (r + 1 < p && block_start(n, p, r + 1) <= i) r++;
+    return r;
+}
+
+int main(int argc, char* argv[]) {
+    int rank, size;
+    int mpi_root = 0;  // Rank 0 is the master
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    if (argc != 2 && argc != 3 && argc != 4 && argc != 5) {
+        if (rank == mpi_root) {
+            printf("Usage: %s <N | M K N> [seed]\n", argv[0]);
+        }
+        MPI_Finalize();
+        return -1;
+    }
+
+    int M, K, N;
+    uint64_t seed = 1;
+    if (argc <= 3) {
+        M = K = N = atoi(argv[1]);
+        if (argc == 3) seed = strtoull(argv[2], NULL, 10);
+    } else {
+        M = atoi(argv[1]);
+        K = atoi(argv[2]);
+        N = atoi(argv[3]);
+        if (argc == 5) seed = strtoull(argv[4], NULL, 10);
+    }
+    uint64_t seed_a = seed * 2, seed_b = seed * 2 + 1;
+
+    // Build the 2-D process grid and its row and column communicators
+    int dims[2] = {0, 0}, periods[2] = {0, 0}, coords[2];
+    MPI_Comm grid_comm, row_comm, col_comm;
+    MPI_Dims_create(size, 2, dims);
+    MPI_Cart_create(MPI_COMM_WORLD, 2, dims, periods, 0, &grid_comm);
+    MPI_Cart_coords(grid_comm, rank, 2, coords);
+    int keep_cols[2] = {0, 1}, keep_rows[2] = {1, 0};
+    MPI_Cart_sub(grid_comm, keep_cols, &row_comm); // ranks in my grid row
+    MPI_Cart_sub(grid_comm, keep_rows, &col_comm); // ranks in my grid column
+
+    int pr = dims[0], pc = dims[1], my_row = coords[0], my_col = coords[1];
+    if (M < pr || N < pc || K < ((pr > pc) ? pr : pc)) {
+        if (rank == mpi_root) {
+            printf("Error: matrix dimensions should be at least the grid size (%d x %d).\n", pr, pc);
+        }
+        MPI_Finalize();
+        return -1;
+    }
+
+    // My blocks: A is rows [m0, m1) x cols [ka0, ka1), B is rows [kb0, kb1) x cols [n0, n1)
+    int m0 = block_start(M, pr, my_row), m1 = block_start(M, pr, my_row + 1);
+    int n0 = block_start(N, pc, my_col), n1 = block_start(N, pc, my_col + 1);
+    int ka0 = block_start(K, pc, my_col), ka1 = block_start(K, pc, my_col + 1);
+    int kb0 = block_start(K, pr, my_row), kb1 = block_start(K, pr, my_row + 1);
+    int mloc = m1 - m0, nloc = n1 - n0, kaloc = ka1 - ka0, kbloc = kb1 - kb0;
+
+    uint16_t *A_local = gemm_alloc((size_t)mloc * kaloc * sizeof(uint16_t));
+    uint16_t *B_local = gemm_alloc((size_t)kbloc * nloc * sizeof(uint16_t));
+    uint32_t *C_local = gemm_alloc((size_t)mloc * nloc * sizeof(uint32_t));
+    uint16_t *A_panel[2], *B_panel[2];
+    for (int b = 0; b < 2; b++) {
+        A_panel[b] = gemm_alloc((size_t)mloc * PANEL_WIDTH * sizeof(uint16_t));
+        B_panel[b] = gemm_alloc((size_t)PANEL_WIDTH * nloc * sizeof(uint16_t));
+    }
+
+    for (int i = 0; i < mloc; i++) {
+        for (int k = 0; k < kaloc; k++) {
+            A_local[(size_t)i * kaloc + k] = counter_rng(seed_a, (uint64_t)(m0 + i) * K + ka0 + k);
+        }
+    }
+    for (int k = 0; k < kbloc; k++) {
+        for (int j = 0; j < nloc; j++) {
+            B_local[(size_t)k * nloc + j] = counter_rng(seed_b, (uint64_t)(kb0 + k) * N + n0 + j);
+        }
+    }
+    memset(C_local, 0, (size_t)mloc * nloc * sizeof(uint32_t));
+
+    // Panels never straddle a block boundary of either distribution of K
+    int num_steps = 0;
+    int *step_start = malloc((K + 1) * sizeof(int));
+    for (int k = 0; k < K; ) {
+        int end = k + PANEL_WIDTH;
+        int a_end = block_start(K, pc, block_owner(K, pc, k) + 1);
+        int b_end = block_start(K, pr, block_owner(K, pr, k) + 1);
+        if (a_end < end) end = a_end;
+        if (b_end < end) end = b_end;
+        if (end > K) end = K;
+        step_start[num_steps++] = k;
+        k = end;
+    }
+    step_start[num_steps] = K;
+
+    double compute_time = 0, comm_time = 0, start_time, end_time, t0;
+    MPI_Request requests[2][2];
+
+    MPI_Barrier(grid_comm);
+    start_time = MPI_Wtime();
+
+    // Copies my part of panel s (if I own it) and posts its two broadcasts
+    #define POST_PANEL(s) do { \
+        int k_lo = step_start[s], width = step_start[(s) + 1] - k_lo, buf = (s) % 2; \
+        int a_root = block_owner(K, pc, k_lo), b_root = block_owner(K, pr, k_lo); \
+        if (my_col == a_root) { \
+            for (int i = 0; i < mloc; i++) \
+                memcpy(&A_panel[buf][(size_t)i * width], &A_local[(size_t)i * kaloc + k_lo - ka0], \
+                       width * sizeof(uint16_t)); \
+        } \
+        if (my_row == b_root) { \
+            memcpy(B_panel[buf], &B_local[(size_t)(k_lo - kb0) * nloc], (size_t)width * nloc * sizeof(uint16_t)); \
+        } \
+        MPI_Ibcast(A_panel[buf], mloc * width, MPI_UINT16_T, a_root, row_comm, &requests[buf][0]); \
+        MPI_Ibcast(B_panel[buf], width * nloc, MPI_UINT16_T, b_root, col_comm, &requests[buf][1]); \
+    } while (0)
+
+    t0 = MPI_Wtime();
+    POST_PANEL(0);
+    comm_time += MPI_Wtime() - t0;
+
+    for (int s = 0; s < num_steps; s++) {
+        int width = step_start[s + 1] - step_start[s], buf = s % 2;
+
+        // Start moving the next panel, then wait for the current one
+        t0 = MPI_Wtime();
+        if (s + 1 < num_steps) POST_PANEL(s + 1);
+        MPI_Waitall(2, requests[buf], MPI_STATUSES_IGNORE);
+        comm_time += MPI_Wtime() - t0;
+
+        // C_local += A_panel * B_panel
+        t0 = MPI_Wtime();
+        gemm_u16_serial_acc(mloc, nloc, width, A_panel[buf], width, B_panel[buf], nloc,
+                            C_local, nloc, s > 0);
+        compute_time += MPI_Wtime() - t0;
+    }
+
+    end_time = MPI_Wtime();
+    double local_elapsed = end_time - start_time, global_elapsed;
+    MPI_Reduce(&local_elapsed, &global_elapsed, 1, MPI_DOUBLE, MPI_MAX, mpi_root, MPI_COMM_WORLD);
+
+    // Verify a few entries of my block of C against a direct dot product
+    int local_errors = 0, global_errors;
+    for (int c = 0; c < CHECKS_PER_RANK; c++) {
+        int i = counter_rng(seed, 2 * c) % mloc, j = counter_rng(seed, 2 * c + 1) % nloc;
+        uint32_t expected = 0;
+        for (int k = 0; k < K; k++) {
+            expected += (uint32_t)(uint16_t)counter_rng(seed_a, (uint64_t)(m0 + i) * K + k) *
+                        (uint16_t)counter_rng(seed_b, (uint64_t)k * N + n0 + j);
+        }
+        if (C_local[(size_t)i * nloc + j] != expected) local_errors++;
+    }
+    MPI_Reduce(&local_errors, &global_errors, 1, MPI_INT, MPI_SUM, mpi_root, MPI_COMM_WORLD);
+
+    // Collect the per-rank breakdown at the master
+    double times[2] = {compute_time, comm_time};
+    double *all_times = (rank == mpi_root) ? malloc(2 * size * sizeof(double)) : NULL;
+    MPI_Gather(times, 2, MPI_DOUBLE, all_times, 2, MPI_DOUBLE, mpi_root, MPI_COMM_WORLD);
+
+    if (rank == mpi_root) {
+        for (int r = 0; r < size; r++) {
+            int rc[2];
+            MPI_Cart_coords(grid_comm, r, 2, rc);
+            printf("Rank %d (%d,%d): compute %0.6f seconds, communication %0.6f seconds\n",
+                   r, rc[0], rc[1], all_times[2 * r], all_times[2 * r + 1]);
+        }
+        printf("SUMMA %dx%dx%d on a %dx%d grid: %0.6f seconds, %0.2f GOP/s\n",
+               M, K, N, pr, pc, global_elapsed, 2.0 * M * K * N / global_elapsed * 1e-9);
+        if (global_errors > 0) {
+            printf("Mismatch found in %d of %d checked entries\n", global_errors, CHECKS_PER_RANK * size);
+        }
+        free(all_times);
+    }
+
+    // Finalize MPI and free allocated memory
+    MPI_Comm_free(&row_comm);
+    MPI_Comm_free(&col_comm);
+    MPI_Comm_free(&grid_comm);
+    MPI_Finalize();
+    for (int b = 0; b < 2; b++) {
+        free(A_panel[b]);
+        free(B_panel[b]);
+    }
+    free(A_local);
+    free(B_local);
+    free(C_local);
+    free(step_start);
+
+    return 0;
+}
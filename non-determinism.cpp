@@ -1,39 +1,27 @@
 #include <iostream>
 #include <thread>
-#include <mutex>
-
-std::mutex mutex;
+#include "async_log.h"
+#include "thread_pool.hpp"
 
+// Each task only appends records to its own log ring; the log writer
+// thread formats them and writes each batch it collects in order of the
+// timestamps, so lines of different tasks may still interleave out of order
+// across batches
 void loop(int n)
 {
-  mutex.lock();
-  std::cout << "Task " << n << " is running." << std::endl;
-  mutex.unlock();
+  async_log("Task %d is running.\n", n);
 
-  mutex.lock();
-  std::cout << "Task " << n << " is terminating." << std::endl;
-  mutex.unlock();
+  async_log("Task %d is terminating.\n", n);
 }
 
 int main(int argc, char *argv[], char* envp[])
 {
-  std::thread t1(loop, 1);
-  std::thread t2(loop, 2);
-  std::thread t3(loop, 3);
-  std::thread t4(loop, 4);
-  std::thread t5(loop, 5);
-  std::thread t6(loop, 6);
-  std::thread t7(loop, 7);
-  std::thread t8(loop, 8);
+  async_log_start(stdout, ASYNC_LOG_BLOCK);
+  ThreadPool pool(8);
+
+  pool.run([](int i) { loop(i + 1); });
 
-  t1.join();
-  t2.join();
-  t3.join();
-  t4.join();
-  t5.join();
-  t6.join();
-  t7.join();
-  t8.join();
+  async_log_stop();
 
   return 0;
 }
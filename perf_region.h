@@ -0,0 +1,243 @@
+/* Hardware counter regions
+ * Wraps a kernel in perf_region_begin()/perf_region_end() and counts cycles,
+ * instructions, L1D and last-level cache read misses and branch misses with
+ * perf_event_open, for user space only (so perf_event_paranoid <= 2 is
+ * enough). perf_region_report() prints, to stderr, the time, IPC, misses per
+ * element and an estimate of the memory traffic (LLC misses x 64 bytes) per
+ * element, per FLOP and per second, which tells a compute-bound kernel (high
+ * IPC, few bytes per FLOP) from a memory-bound one.
+ *
+ * Nothing is counted or printed unless PERF_REGIONS is set: 1 reports totals,
+ * "threads" adds a line per OpenMP thread. Counters are opened for every
+ * thread of the OpenMP team when the region is initialised, so initialise
+ * after omp_set_num_threads(). Threads created later (a ThreadPool, the
+ * ws_sched.h workers) inherit the counters, but the kernel adds a child's
+ * counts to the parent's only when the child exits: long-lived workers are
+ * not counted while the region runs, and their counts land in whichever
+ * begin/end pair is open when they are joined. Reports of such kernels
+ * cover the OpenMP team only. Where the
+ * kernel, the container or the CPU offers no counters the report falls back to
+ * time and throughput; an event the CPU lacks is shown as n/a.
+ *
+ * Usage:
+ *     perf_region r;
+ *     perf_region_init(&r, "life");
+ *     for each repetition {
+ *         perf_region_begin(&r);
+ *         kernel
+ *         perf_region_end(&r);
+ *     }
+ *     perf_region_report(&r, cells, "cell", flops);  // per begin/end pair
+ *     perf_region_close(&r);
+*/
+
+#ifndef PERF_REGION_H
+#define PERF_REGION_H
+
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#define PERF_REGION_LINE 64 /* bytes moved per last-level cache miss */
+
+enum {
+    PERF_REGION_CYCLES,
+    PERF_REGION_INSTRUCTIONS,
+    PERF_REGION_L1D_MISSES,
+    PERF_REGION_LLC_MISSES,
+    PERF_REGION_BRANCH_MISSES,
+    PERF_REGION_EVENTS
+};
+
+/* Counters of one thread: file descriptors (-1 if unavailable), the raw
+ * value, enabled and running times at perf_region_begin() and the totals
+ * since perf_region_init(), scaled up when the kernel multiplexed them */
+typedef struct {
+    int fd[PERF_REGION_EVENTS];
+    uint64_t start[PERF_REGION_EVENTS][3];
+    double count[PERF_REGION_EVENTS];
+} perf_region_thread;
+
+typedef struct {
+    char name[64];
+    int mode;      /* 0 off, 1 totals, 2 totals and threads */
+    int counters;  /* whether any hardware event could be opened */
+    int threads;
+    perf_region_thread *thread;
+    double start, seconds;
+    long calls;
+} perf_region;
+
+static inline int perf_region_open(uint32_t type, uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.inherit = 1; /* children are counted once they exit */
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/* Opens the events for the calling thread; returns how many opened */
+static inline int perf_region_open_thread(perf_region_thread *t) {
+    static const uint64_t read_miss =
+        (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    t->fd[PERF_REGION_CYCLES] = perf_region_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    t->fd[PERF_REGION_INSTRUCTIONS] = perf_region_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    t->fd[PERF_REGION_L1D_MISSES] = perf_region_open(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | read_miss);
+    t->fd[PERF_REGION_LLC_MISSES] = perf_region_open(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | read_miss);
+    t->fd[PERF_REGION_BRANCH_MISSES] = perf_region_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    int opened = 0;
+    for (int e = 0; e < PERF_REGION_EVENTS; e++) opened += t->fd[e] >= 0;
+    return opened;
+}
+
+static inline double perf_region_now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static inline void perf_region_init(perf_region *r, const char *name) {
+    const char *mode = getenv("PERF_REGIONS");
+    memset(r, 0, sizeof(*r));
+    snprintf(r->name, sizeof(r->name), "%s", name);
+    if (mode == NULL || mode[0] == '\0' || strcmp(mode, "0") == 0) return;
+    r->mode = (strcmp(mode, "threads") == 0) ? 2 : 1;
+
+    r->threads = 1;
+#ifdef _OPENMP
+    r->threads = omp_get_max_threads();
+#endif
+    r->thread = (perf_region_thread *)calloc(r->threads, sizeof(perf_region_thread));
+    int opened = 0, error = 0;
+#ifdef _OPENMP
+    #pragma omp parallel num_threads(r->threads) reduction(+:opened) reduction(max:error)
+#endif
+    {
+        int id = 0;
+#ifdef _OPENMP
+        id = omp_get_thread_num();
+#endif
+        opened += perf_region_open_thread(&r->thread[id]);
+        if (r->thread[id].fd[PERF_REGION_CYCLES] < 0) error = errno;
+    }
+    r->counters = opened > 0;
+
+    static int warned = 0;
+    if (!r->counters && !warned) {
+        fprintf(stderr, "perf_region: hardware counters unavailable (%s), reporting time only\n", strerror(error));
+        warned = 1;
+    }
+}
+
+static inline void perf_region_begin(perf_region *r) {
+    if (r->mode == 0) return;
+    for (int i = 0; r->counters && i < r->threads; i++) {
+        perf_region_thread *t = &r->thread[i];
+        for (int e = 0; e < PERF_REGION_EVENTS; e++) {
+            if (t->fd[e] >= 0 && read(t->fd[e], t->start[e], sizeof(t->start[e])) != sizeof(t->start[e])) {
+                t->start[e][0] = t->start[e][1] = t->start[e][2] = 0;
+            }
+        }
+    }
+    r->start = perf_region_now();
+}
+
+static inline void perf_region_end(perf_region *r) {
+    if (r->mode == 0) return;
+    r->seconds += perf_region_now() - r->start;
+    r->calls++;
+    for (int i = 0; r->counters && i < r->threads; i++) {
+        perf_region_thread *t = &r->thread[i];
+        for (int e = 0; e < PERF_REGION_EVENTS; e++) {
+            uint64_t now[3];
+            if (t->fd[e] < 0 || read(t->fd[e], now, sizeof(now)) != sizeof(now)) continue;
+            double value = (double)(now[0] - t->start[e][0]);
+            double enabled = (double)(now[1] - t->start[e][1]), running = (double)(now[2] - t->start[e][2]);
+            t->count[e] += (running > 0) ? value * enabled / running : value;
+        }
+    }
+}
+
+/* Prints the counters of one thread, or of all of them (t == NULL) */
+static inline void perf_region_print(const perf_region *r, const perf_region_thread *t, const char *label,
+                                     double elements, const char *unit, double flops) {
+    double count[PERF_REGION_EVENTS] = {0};
+    int present[PERF_REGION_EVENTS] = {0};
+    for (int i = 0; i < r->threads; i++) {
+        const perf_region_thread *s = (t != NULL) ? t : &r->thread[i];
+        for (int e = 0; e < PERF_REGION_EVENTS; e++) {
+            if (s->fd[e] < 0) continue;
+            count[e] += s->count[e];
+            present[e] = 1;
+        }
+        if (t != NULL) break;
+    }
+
+    fprintf(stderr, "%s:", label);
+    if (present[PERF_REGION_CYCLES]) fprintf(stderr, " %.4g cycles,", count[PERF_REGION_CYCLES]);
+    if (present[PERF_REGION_CYCLES] && present[PERF_REGION_INSTRUCTIONS] && count[PERF_REGION_CYCLES] > 0) {
+        fprintf(stderr, " IPC %.2f,", count[PERF_REGION_INSTRUCTIONS] / count[PERF_REGION_CYCLES]);
+    } else {
+        fprintf(stderr, " IPC n/a,");
+    }
+    static const char *names[PERF_REGION_EVENTS] = {NULL, NULL, "L1D", "LLC", "branch"};
+    fprintf(stderr, " misses per %s:", unit);
+    for (int e = PERF_REGION_L1D_MISSES; e < PERF_REGION_EVENTS; e++) {
+        if (present[e] && elements > 0) fprintf(stderr, " %s %.4g", names[e], count[e] / elements);
+        else fprintf(stderr, " %s n/a", names[e]);
+    }
+    if (present[PERF_REGION_LLC_MISSES]) {
+        double bytes = count[PERF_REGION_LLC_MISSES] * PERF_REGION_LINE;
+        if (elements > 0) fprintf(stderr, ", %.3g bytes/%s", bytes / elements, unit);
+        if (flops > 0) fprintf(stderr, ", %.3g bytes/FLOP", bytes / flops);
+        if (t == NULL && r->seconds > 0) fprintf(stderr, ", %.3g GB/s", bytes / r->seconds * 1e-9);
+    }
+    fprintf(stderr, "\n");
+}
+
+/* Reports the region; elements and flops are the work of one begin/end pair */
+static inline void perf_region_report(const perf_region *r, double elements, const char *unit, double flops) {
+    if (r->mode == 0 || r->calls == 0) return;
+    double total = elements * r->calls, total_flops = flops * r->calls;
+    fprintf(stderr, "perf[%s]: %.6f s over %ld call%s, %.4g %ss/s", r->name, r->seconds, r->calls,
+            (r->calls == 1) ? "" : "s", (r->seconds > 0) ? total / r->seconds : 0, unit);
+    if (flops > 0 && r->seconds > 0) fprintf(stderr, ", %.4g GFLOP/s", total_flops / r->seconds * 1e-9);
+    if (!r->counters) {
+        fprintf(stderr, " (no hardware counters)\n");
+        return;
+    }
+    fprintf(stderr, "\n");
+    perf_region_print(r, NULL, "  total", total, unit, total_flops);
+    for (int i = 0; r->mode == 2 && i < r->threads; i++) {
+        char label[32];
+        snprintf(label, sizeof(label), "  thread %d", i);
+        perf_region_print(r, &r->thread[i], label, total, unit, total_flops);
+    }
+}
+
+static inline void perf_region_close(perf_region *r) {
+    for (int i = 0; r->thread != NULL && i < r->threads; i++) {
+        for (int e = 0; e < PERF_REGION_EVENTS; e++) {
+            if (r->thread[i].fd[e] >= 0) close(r->thread[i].fd[e]);
+        }
+    }
+    free(r->thread);
+    r->thread = NULL;
+    r->mode = 0;
+}
+
+#endif /* PERF_REGION_H */
@@ -1,8 +1,40 @@
 #include <iostream>
+#include <iomanip>
 #include <thread>
 #include <chrono>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <algorithm>
+#include "bench.h"
+#include "thread_pool.hpp"
 
-const int iterations = 100;
+const int iterations = 100;    // repetitions of the update kernel
+const int stream_reps = 10;    // timed repetitions of the other kernels
+const size_t cache_line = 64;
+
+// Memory access patterns; STREAM-style kernels work on doubles
+enum Kernel { UPDATE, READ, WRITE, COPY, SCALE, ADD, TRIAD };
+
+const char *kernel_names[] = { "update", "read", "write", "copy", "scale", "add", "triad" };
+
+// Bytes moved and elements touched per array element for each kernel
+const int kernel_bytes[] = { 2, 8, 8, 16, 16, 24, 24 };
+const int kernel_arrays[] = { 1, 1, 1, 2, 2, 3, 3 };
+
+// Keeps the result of the read kernel alive
+std::atomic<double> sink(0);
+
+typedef std::chrono::steady_clock Clock;
+
+// Wall time of one parallel pass: first thread start to last thread end
+double span(std::vector<Clock::time_point> const &starts, std::vector<Clock::time_point> const &ends)
+{
+  std::chrono::duration<double> duration =
+    *std::max_element(ends.begin(), ends.end()) - *std::min_element(starts.begin(), starts.end());
+  return duration.count();
+}
 
 void loop(char *data, int size)
 {
@@ -15,18 +47,194 @@ void loop(char *data, int size)
     }
 }
 
+// One pass of a kernel over elements [0, n) of the thread's slices
+void run_kernel(Kernel kernel, char *bytes, double *a, double *b, double *c, size_t n)
+{
+  const double scalar = 3.0;
+  switch (kernel)
+    {
+    case UPDATE:
+      loop(bytes, n);
+      break;
+    case READ:
+      {
+        double sum = 0;
+        for (size_t i=0; i<n; ++i)
+          {
+            sum += a[i];
+          }
+        sink.store(sum, std::memory_order_relaxed);
+        break;
+      }
+    case WRITE:
+      for (size_t i=0; i<n; ++i)
+        {
+          a[i] = scalar;
+        }
+      break;
+    case COPY:
+      for (size_t i=0; i<n; ++i)
+        {
+          c[i] = a[i];
+        }
+      break;
+    case SCALE:
+      for (size_t i=0; i<n; ++i)
+        {
+          b[i] = scalar * c[i];
+        }
+      break;
+    case ADD:
+      for (size_t i=0; i<n; ++i)
+        {
+          c[i] = a[i] + b[i];
+        }
+      break;
+    case TRIAD:
+      for (size_t i=0; i<n; ++i)
+        {
+          a[i] = b[i] + scalar * c[i];
+        }
+      break;
+    }
+}
+
+// Times a kernel over a working set of `size` bytes split across the
+// pool's pinned workers. Allocation, first touch and one warmup pass happen
+// before timing; returns the best time of `reps` passes, all of which are
+// stored in `times`.
+double measure(ThreadPool &pool, Kernel kernel, size_t size, int reps, size_t &accesses, std::vector<double> &times)
+{
+  int threads = pool.size();
+  int arrays = kernel_arrays[kernel];
+  size_t element = (kernel == UPDATE) ? 1 : sizeof(double);
+  size_t per_thread = std::max<size_t>(1, size / arrays / element / threads);
+  accesses = per_thread * threads * ((kernel == UPDATE) ? iterations : 1);
+
+  // three cache-line aligned slices per thread; kernels use the ones they need
+  size_t slice = (per_thread * element + cache_line - 1) / cache_line * cache_line;
+  char *memory = static_cast<char *>(aligned_alloc(cache_line, slice * 3 * threads));
+  pool.run([=](int i)
+    {
+      std::memset(memory + slice * 3 * i, 1, slice * 3);  // first touch by the owner
+    });
+
+  std::vector<Clock::time_point> starts(threads), ends(threads);
+  double best = 0;
+  times.clear();
+  for (int r=0; r<=reps; ++r)
+    {
+      pool.run([=, &starts, &ends](int i)
+        {
+          char *mine = memory + slice * 3 * i;
+          double *a = reinterpret_cast<double *>(mine);
+          double *b = reinterpret_cast<double *>(mine + slice);
+          double *c = reinterpret_cast<double *>(mine + 2 * slice);
+          starts[i] = Clock::now();
+          run_kernel(kernel, mine, a, b, c, per_thread);
+          ends[i] = Clock::now();
+        });
+      double seconds = span(starts, ends);
+      if (r > 0)  // pass 0 is the warmup
+        {
+          times.push_back(seconds);
+        }
+      if (r == 1 || (r > 1 && seconds < best))
+        {
+          best = seconds;
+        }
+    }
+
+  free(memory);
+  return best;
+}
+
+// Hands the timed passes to the benchmark harness when BENCH_FORMAT asks
+// for JSON or CSV
+void emit(ThreadPool &pool, Kernel kernel, size_t size, std::vector<double> const &times, double bytes)
+{
+  if (bench_machine_output())
+    {
+      std::string params = std::string("kernel=") + kernel_names[kernel] + ",threads=" + std::to_string(pool.size())
+        + ",size_kb=" + std::to_string(size / 1024);
+      bench_report("performance", params.c_str(), times.data(), times.size(), bytes * 1e-9, "GB/s");
+    }
+}
+
+void report(ThreadPool &pool, Kernel kernel, size_t size, int reps)
+{
+  size_t accesses;
+  std::vector<double> times;
+  double seconds = measure(pool, kernel, size, reps, accesses, times);
+  double bytes = double(accesses) * kernel_bytes[kernel];
+  emit(pool, kernel, size, times, bytes);
+  std::cout << std::left << std::setw(8) << kernel_names[kernel] << std::right
+            << std::setw(8) << pool.size()
+            << std::setw(12) << size / 1024
+            << std::setw(12) << std::fixed << std::setprecision(2) << bytes / seconds * 1e-9
+            << std::setw(12) << std::setprecision(3) << seconds * 1e9 / accesses
+            << std::setw(14) << std::setprecision(6) << seconds << std::endl;
+}
+
+void header()
+{
+  std::cout << std::left << std::setw(8) << "kernel" << std::right
+            << std::setw(8) << "threads" << std::setw(12) << "size (KB)"
+            << std::setw(12) << "GB/s" << std::setw(12) << "ns/access"
+            << std::setw(14) << "seconds" << std::endl;
+}
+
+// Per-thread counters packed into one cache line, or one line each
+struct PackedCounter { volatile long value; };
+struct alignas(64) PaddedCounter { volatile long value; };
+
+template <typename Counter>
+double count_in_parallel(ThreadPool &pool, long increments)
+{
+  int threads = pool.size();
+  std::vector<Counter> counters(threads);
+  std::vector<Clock::time_point> starts(threads), ends(threads);
+  pool.run([&](int i)
+    {
+      starts[i] = Clock::now();
+      for (long n=0; n<increments; ++n)
+        {
+          counters[i].value = counters[i].value + 1;
+        }
+      ends[i] = Clock::now();
+    });
+  return span(starts, ends);
+}
+
+void false_sharing(ThreadPool &pool, long increments)
+{
+  double packed = count_in_parallel<PackedCounter>(pool, increments);
+  double padded = count_in_parallel<PaddedCounter>(pool, increments);
+  std::cout << "False sharing, " << pool.size() << " threads, " << increments << " increments each:" << std::endl;
+  std::cout << "  interleaved counters: " << std::fixed << std::setprecision(3)
+            << packed * 1e9 / increments << " ns/increment" << std::endl;
+  std::cout << "  padded counters:      " << padded * 1e9 / increments << " ns/increment" << std::endl;
+  std::cout << "  slowdown from sharing: " << std::setprecision(2) << packed / padded << "x" << std::endl;
+}
+
 void usage(char *program)
 {
-  std::cout << "Usage: " << program << " T N" << std::endl;
+  std::cout << "Usage: " << program << " T N [mode]" << std::endl;
   std::cout << std::endl;
   std::cout << "  T: number of threads" << std::endl;
   std::cout << "  N: array size in MB" << std::endl;
+  std::cout << "  mode: update (default), read, write, copy, scale, add, triad," << std::endl;
+  std::cout << "        stream (copy, scale, add and triad), sweep (read and triad" << std::endl;
+  std::cout << "        from 16 KB up to N MB), false-sharing, or all" << std::endl;
+  std::cout << std::endl;
+  std::cout << "Threads are pinned as set by THREAD_PLACEMENT: cores (default)," << std::endl;
+  std::cout << "compact, scatter, none, or a CPU list such as 0,2,4-7" << std::endl;
   exit(1);
 }
 
 int main(int argc, char *argv[])
 {
-  if (argc != 3)
+  if (argc != 3 && argc != 4)
     {
       usage(argv[0]);
     }
@@ -61,35 +269,64 @@ int main(int argc, char *argv[])
       usage(argv[0]);
     }
 
-  // *** timing begins here ***
-  auto start_time = std::chrono::system_clock::now();
+  std::string mode = (argc == 4) ? argv[3] : "update";
+  size_t bytes = size_t(size) * 1024 * 1024;  // convert size from MB to bytes
+  ThreadPool pool(threads);  // pinned as set by THREAD_PLACEMENT
 
-  // allocate and initialize data[]
-  size *= 1024 * 1024; // convert size from MB to bytes
-  char *data = new char[size]();
-
-  // create and join threads
-  std::thread *t = new std::thread[threads];
-  int size_per_thread = size / threads;
-  char *thread_data = data;
-  for (int i=0; i<threads; ++i)
+  if (mode == "update")
     {
-      t[i] = std::thread(loop, thread_data, size_per_thread);
-      thread_data += size_per_thread;
+      size_t accesses;
+      std::vector<double> times;
+      double seconds = measure(pool, UPDATE, bytes, 1, accesses, times);
+      emit(pool, UPDATE, bytes, times, double(accesses) * kernel_bytes[UPDATE]);
+      std::cout << "Finished in " << seconds << " seconds (wall clock, kernel only)." << std::endl;
+      std::cout << std::fixed << std::setprecision(2) << accesses * kernel_bytes[UPDATE] / seconds * 1e-9
+                << " GB/s, " << std::setprecision(3) << seconds * 1e9 / accesses << " ns/access" << std::endl;
+      return 0;
     }
 
-  for (int i=0; i<threads; ++i)
+  bool all = (mode == "all");
+  bool known = all || mode == "stream" || mode == "sweep" || mode == "false-sharing";
+  if (!known)
+    {
+      for (int k=READ; k<=TRIAD; ++k)
+        {
+          known = known || mode == kernel_names[k];
+        }
+    }
+  if (!known)
     {
-      t[i].join();
+      usage(argv[0]);
     }
 
-  delete[] data;
+  if (mode != "false-sharing")
+    {
+      header();
+    }
+  for (int k=READ; k<=TRIAD; ++k)
+    {
+      bool stream = (k >= COPY) && (mode == "stream" || all);
+      if (mode == kernel_names[k] || stream || (all && k <= WRITE))
+        {
+          report(pool, Kernel(k), bytes, stream_reps);
+        }
+    }
 
-  std::chrono::duration<double> duration =
-    (std::chrono::system_clock::now() - start_time);
-  // *** timing ends here ***
+  // working sets from L1 to DRAM, repeated so each point moves at least 1 GB
+  if (mode == "sweep" || all)
+    {
+      for (size_t set = 16 * 1024; set <= bytes; set *= 2)
+        {
+          int reps = std::max<size_t>(stream_reps, (size_t(1) << 30) / set);
+          report(pool, READ, set, reps);
+          report(pool, TRIAD, set, reps);
+        }
+    }
 
-  std::cout << "Finished in " << duration.count() << " seconds (wall clock)." << std::endl;
+  if (mode == "false-sharing" || all)
+    {
+      false_sharing(pool, 100000000L / threads);
+    }
 
   return 0;
 }
@@ -0,0 +1,408 @@
+// Prime queries over a cache of sieved segments
+//
+// PrimeIndex answers is_prime(n), count_primes(lo, hi), primes_in(lo, hi)
+// and nth_prime(k) for numbers up to a limit fixed at construction, without
+// sieving the whole range up front. The numbers are split into segments of
+// segment_numbers; a segment is sieved with the base primes up to
+// sqrt(limit) into one bit per odd number (16 KB per segment) the first
+// time a query needs its bits, and kept in an LRU cache of shared,
+// immutable segments. Next to the cache a compact index holds the prime
+// count of every segment (4 bytes each) once it is known, so a count or
+// nth_prime query only sieves the two partial segments at its ends and the
+// full segments nobody has counted yet. Counting a full segment uses a
+// per-thread scratch segment and does not evict cached bits.
+//
+// All queries may be called concurrently. The cache lock is held only to
+// look up, insert or evict a segment, never while sieving; two threads
+// missing the same segment may both sieve it, and the first insert wins.
+// Ranges are inclusive; a query above limit() throws std::out_of_range.
+
+#ifndef PRIME_INDEX_HPP
+#define PRIME_INDEX_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class PrimeIndex
+{
+public:
+  static constexpr uint64_t segment_numbers = uint64_t(1) << 18;
+  static constexpr size_t segment_words = segment_numbers / 128;   // one bit per odd number
+
+  // Bits of one segment: bit i of the segment starting at base is base + 2i + 1
+  struct Segment
+  {
+    uint64_t base;
+    uint64_t words[segment_words];
+  };
+
+  explicit PrimeIndex(uint64_t limit = uint64_t(1) << 32, size_t cache_segments = 1024)
+    : max_number(limit), capacity(cache_segments > 0 ? cache_segments : 1),
+      counts(limit / segment_numbers + 1)
+  {
+    for (auto &count : counts)
+      {
+        count.store(unknown, std::memory_order_relaxed);
+      }
+
+    // Odd base primes up to sqrt(limit), by a plain sieve
+    uint64_t root = uint64_t(std::sqrt(double(limit)));
+    while (root * root > limit)
+      {
+        --root;
+      }
+    while ((root + 1) * (root + 1) <= limit)
+      {
+        ++root;
+      }
+    std::vector<bool> composite(root + 1, false);
+    for (uint64_t i=3; i<=root; i+=2)
+      {
+        if (!composite[i])
+          {
+            base_primes.push_back(uint32_t(i));
+            for (uint64_t j=i*i; j<=root; j+=2*i)
+              {
+                composite[j] = true;
+              }
+          }
+      }
+  }
+
+  uint64_t limit() const
+  {
+    return max_number;
+  }
+
+  bool is_prime(uint64_t n)
+  {
+    check(n);
+    if (n < 3 || n % 2 == 0)
+      {
+        return n == 2;
+      }
+    std::shared_ptr<const Segment> s = segment(n / segment_numbers);
+    uint64_t bit = (n - s->base) / 2;
+    return (s->words[bit / 64] >> (bit % 64)) & 1;
+  }
+
+  // Number of primes p with lo <= p <= hi
+  uint64_t count_primes(uint64_t lo, uint64_t hi)
+  {
+    check(hi);
+    if (lo > hi)
+      {
+        return 0;
+      }
+    uint64_t total = (lo <= 2 && hi >= 2) ? 1 : 0;
+    uint64_t first = lo / segment_numbers, last = hi / segment_numbers;
+    for (uint64_t s=first; s<=last; ++s)
+      {
+        uint64_t base = s * segment_numbers;
+        uint64_t from = (s == first) ? lo : base;
+        uint64_t to = (s == last) ? hi : base + segment_numbers - 1;
+        if (from == base && to == base + segment_numbers - 1)
+          {
+            total += segment_count(s);
+          }
+        else
+          {
+            total += count_bits(*segment(s), from, to);
+          }
+      }
+    return total;
+  }
+
+  // The primes p with lo <= p <= hi, in increasing order
+  std::vector<uint64_t> primes_in(uint64_t lo, uint64_t hi)
+  {
+    check(hi);
+    std::vector<uint64_t> primes;
+    if (lo > hi)
+      {
+        return primes;
+      }
+    if (lo <= 2 && hi >= 2)
+      {
+        primes.push_back(2);
+      }
+    for (uint64_t s=lo/segment_numbers; s<=hi/segment_numbers; ++s)
+      {
+        std::shared_ptr<const Segment> segment_bits = segment(s);
+        uint64_t base = segment_bits->base;
+        uint64_t from = std::max(lo, base), to = std::min(hi, base + segment_numbers - 1);
+        for_each_bit(*segment_bits, from, to, [&](uint64_t bit)
+          {
+            primes.push_back(base + 2 * bit + 1);
+          });
+      }
+    return primes;
+  }
+
+  // The k-th prime, counting 2 as the first
+  uint64_t nth_prime(uint64_t k)
+  {
+    if (k == 0)
+      {
+        throw std::out_of_range("nth_prime: k starts at 1");
+      }
+    if (k == 1)
+      {
+        check(2);
+        return 2;
+      }
+    uint64_t remaining = k - 1;   // odd primes still to skip
+    for (uint64_t s=0; s<counts.size(); ++s)
+      {
+        uint64_t count = segment_count(s);
+        if (remaining > count)
+          {
+            remaining -= count;
+            continue;
+          }
+        std::shared_ptr<const Segment> segment_bits = segment(s);
+        for (size_t w=0; w<segment_words; ++w)
+          {
+            uint64_t word = segment_bits->words[w];
+            uint64_t ones = __builtin_popcountll(word);
+            if (remaining > ones)
+              {
+                remaining -= ones;
+                continue;
+              }
+            for (; remaining > 1; --remaining)
+              {
+                word &= word - 1;
+              }
+            uint64_t p = segment_bits->base + 2 * (w * 64 + __builtin_ctzll(word)) + 1;
+            check(p);
+            return p;
+          }
+      }
+    throw std::out_of_range("nth_prime: beyond the limit of " + std::to_string(max_number));
+  }
+
+  // Cache statistics since construction
+  uint64_t cache_hits() const
+  {
+    return hits.load(std::memory_order_relaxed);
+  }
+
+  uint64_t cache_misses() const
+  {
+    return misses.load(std::memory_order_relaxed);
+  }
+
+  uint64_t segments_sieved() const
+  {
+    return sieved.load(std::memory_order_relaxed);
+  }
+
+private:
+  static constexpr uint32_t unknown = ~uint32_t(0);
+
+  typedef std::list<uint64_t> Order;   // segment numbers, most recently used first
+
+  struct Entry
+  {
+    std::shared_ptr<const Segment> bits;
+    Order::iterator position;
+  };
+
+  void check(uint64_t n) const
+  {
+    if (n > max_number)
+      {
+        throw std::out_of_range(std::to_string(n) + " is beyond the limit of " + std::to_string(max_number));
+      }
+  }
+
+  // Sieves segment s into out; 1 and numbers above the limit are not prime
+  void sieve(uint64_t s, Segment &out)
+  {
+    sieved.fetch_add(1, std::memory_order_relaxed);
+    out.base = s * segment_numbers;
+    std::fill(out.words, out.words + segment_words, ~uint64_t(0));
+    uint64_t end = out.base + segment_numbers;
+    for (uint32_t p : base_primes)
+      {
+        uint64_t square = uint64_t(p) * p;
+        if (square >= end)
+          {
+            break;
+          }
+        // First odd multiple of p in the segment, not below p * p
+        uint64_t start = (square >= out.base) ? square : (out.base + p - 1) / p * p;
+        if (start % 2 == 0)
+          {
+            start += p;
+          }
+        for (uint64_t bit=(start - out.base)/2; bit<segment_numbers/2; bit+=p)
+          {
+            out.words[bit / 64] &= ~(uint64_t(1) << (bit % 64));
+          }
+      }
+    if (s == 0)
+      {
+        out.words[0] &= ~uint64_t(1);
+      }
+    if (end - 1 > max_number)
+      {
+        clear_above(out, max_number);
+      }
+  }
+
+  static void clear_above(Segment &out, uint64_t n)
+  {
+    uint64_t first = (n + 1 > out.base) ? (n + 1 - out.base) / 2 : 0;
+    for (uint64_t bit=first; bit<segment_numbers/2; ++bit)
+      {
+        out.words[bit / 64] &= ~(uint64_t(1) << (bit % 64));
+      }
+  }
+
+  // Mask of the bits of word w that stand for numbers in [from, to]
+  static uint64_t range_mask(uint64_t base, size_t w, uint64_t from, uint64_t to)
+  {
+    uint64_t first = (from > base) ? (from - base) / 2 : 0;   // first odd >= from
+    uint64_t last = (to - base + 1) / 2;                       // one past the last odd <= to
+    uint64_t lo = w * 64, hi = lo + 64;
+    lo = std::max(lo, first);
+    hi = std::min(hi, last);
+    if (lo >= hi)
+      {
+        return 0;
+      }
+    uint64_t width = hi - lo, shift = lo - w * 64;
+    return ((width == 64) ? ~uint64_t(0) : ((uint64_t(1) << width) - 1)) << shift;
+  }
+
+  // Calls f(bit) for every prime bit standing for a number in [from, to]
+  template <typename F>
+  static void for_each_bit(Segment const &s, uint64_t from, uint64_t to, F f)
+  {
+    size_t first = (from - s.base) / 128, last = (to - s.base) / 128;
+    for (size_t w=first; w<=last; ++w)
+      {
+        uint64_t word = s.words[w] & range_mask(s.base, w, from, to);
+        while (word != 0)
+          {
+            f(w * 64 + __builtin_ctzll(word));
+            word &= word - 1;
+          }
+      }
+  }
+
+  // Odd primes in [from, to], both inside the segment
+  static uint64_t count_bits(Segment const &s, uint64_t from, uint64_t to)
+  {
+    size_t first = (from - s.base) / 128, last = (to - s.base) / 128;
+    uint64_t count = 0;
+    for (size_t w=first; w<=last; ++w)
+      {
+        uint64_t word = s.words[w];
+        if (w == first || w == last)
+          {
+            word &= range_mask(s.base, w, from, to);
+          }
+        count += __builtin_popcountll(word);
+      }
+    return count;
+  }
+
+  // Odd primes in segment s, from the index, the cache or a scratch sieve
+  uint64_t segment_count(uint64_t s)
+  {
+    uint32_t count = counts[s].load(std::memory_order_relaxed);
+    if (count != unknown)
+      {
+        return count;
+      }
+    std::shared_ptr<const Segment> cached = lookup(s);
+    if (cached)
+      {
+        count = uint32_t(count_bits(*cached, cached->base, cached->base + segment_numbers - 1));
+      }
+    else
+      {
+        thread_local std::unique_ptr<Segment> scratch(new Segment);
+        sieve(s, *scratch);
+        count = uint32_t(count_bits(*scratch, scratch->base, scratch->base + segment_numbers - 1));
+      }
+    counts[s].store(count, std::memory_order_relaxed);
+    return count;
+  }
+
+  // The cached segment s, or null; marks it as most recently used
+  std::shared_ptr<const Segment> lookup(uint64_t s)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = entries.find(s);
+    if (found == entries.end())
+      {
+        return nullptr;
+      }
+    order.splice(order.begin(), order, found->second.position);
+    return found->second.bits;
+  }
+
+  // Segment s from the cache, sieving and inserting it on a miss
+  std::shared_ptr<const Segment> segment(uint64_t s)
+  {
+    std::shared_ptr<const Segment> bits = lookup(s);
+    if (bits)
+      {
+        hits.fetch_add(1, std::memory_order_relaxed);
+        return bits;
+      }
+    misses.fetch_add(1, std::memory_order_relaxed);
+
+    std::shared_ptr<Segment> fresh = std::make_shared<Segment>();
+    sieve(s, *fresh);
+    if (counts[s].load(std::memory_order_relaxed) == unknown)
+      {
+        counts[s].store(uint32_t(count_bits(*fresh, fresh->base, fresh->base + segment_numbers - 1)),
+                        std::memory_order_relaxed);
+      }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = entries.find(s);
+    if (found != entries.end())
+      {
+        return found->second.bits;   // another thread sieved it first
+      }
+    if (entries.size() >= capacity)
+      {
+        entries.erase(order.back());
+        order.pop_back();
+      }
+    order.push_front(s);
+    entries[s] = Entry{fresh, order.begin()};
+    return fresh;
+  }
+
+  const uint64_t max_number;
+  const size_t capacity;
+  std::vector<uint32_t> base_primes;
+  std::vector<std::atomic<uint32_t>> counts;   // per segment, unknown until sieved
+
+  std::mutex mutex;   // guards order and entries
+  Order order;
+  std::unordered_map<uint64_t, Entry> entries;
+
+  std::atomic<uint64_t> hits{0};
+  std::atomic<uint64_t> misses{0};
+  std::atomic<uint64_t> sieved{0};
+};
+
+#endif // PRIME_INDEX_HPP
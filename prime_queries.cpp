@@ -0,0 +1,183 @@
+#include <iostream>
+#include <iomanip>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include "bench.h"
+#include "counter_rng.h"
+#include "prime_index.hpp"
+#include "thread_pool.hpp"
+
+// Prime range queries served from a PrimeIndex instead of a full sieve per
+// run. Checks the index against a plain sieve, then has the pool's workers
+// answer a stream of count, membership, listing and nth-prime queries that
+// mostly fall around a few hot spots, the way a service sees repeated and
+// overlapping ranges, and compares the time per query with one full sieve.
+
+const uint64_t check_max = 10000000;   // range checked against a plain sieve
+const int hot_spots = 32;              // query centres that most queries fall near
+const uint64_t max_width = 1 << 20;    // widest range of a query
+
+void usage(char const *program)
+{
+  std::cerr << "Usage: " << program << " <num_threads> [queries [limit [cache_segments]]]" << std::endl;
+  std::exit(1);
+}
+
+// Compares every query kind with a plain sieve of [0, check_max]
+bool check(PrimeIndex &index)
+{
+  std::vector<bool> prime(check_max + 1, true);
+  prime[0] = prime[1] = false;
+  for (uint64_t i=2; i*i<=check_max; ++i)
+    {
+      if (prime[i])
+        {
+          for (uint64_t j=i*i; j<=check_max; j+=i)
+            {
+              prime[j] = false;
+            }
+        }
+    }
+  std::vector<uint64_t> pi(check_max + 2, 0);   // pi[n] = primes below n
+  for (uint64_t i=0; i<=check_max; ++i)
+    {
+      pi[i + 1] = pi[i] + prime[i];
+    }
+
+  bool ok = index.count_primes(0, 1000000) == 78498 && index.count_primes(0, 10000000) == 664579
+            && index.nth_prime(78498) == 999983 && index.nth_prime(664579) == 9999991
+            && index.nth_prime(1) == 2 && index.nth_prime(2) == 3;
+  for (uint64_t q=0; ok && q<2000; ++q)
+    {
+      uint64_t lo = counter_rng(1, 2 * q) % check_max;
+      uint64_t hi = std::min(check_max, lo + counter_rng(1, 2 * q + 1) % (q % 2 ? max_width : 300));
+      std::vector<uint64_t> primes = index.primes_in(lo, hi);
+      ok = index.count_primes(lo, hi) == pi[hi + 1] - pi[lo] && primes.size() == pi[hi + 1] - pi[lo]
+           && index.is_prime(lo) == prime[lo] && index.is_prime(hi) == prime[hi];
+      for (size_t i=0; ok && i<primes.size(); ++i)
+        {
+          ok = prime[primes[i]] && (i == 0 || primes[i - 1] < primes[i]);
+        }
+      uint64_t k = pi[hi + 1];
+      ok = ok && (k == 0 || prime[index.nth_prime(k)]) && (k == 0 || pi[index.nth_prime(k)] == k - 1);
+    }
+  return ok;
+}
+
+// Answers query q; the sum of the answers checks that every run agrees
+uint64_t query(PrimeIndex &index, uint64_t q)
+{
+  uint64_t limit = index.limit();
+  uint64_t r = counter_rng(2, q);
+  uint64_t centre = (r % 10 == 0) ? counter_rng(3, q) % limit : counter_rng(4, r % hot_spots) % limit;
+  uint64_t lo = centre - std::min(centre, counter_rng(5, q) % max_width);
+  uint64_t hi = std::min(limit, lo + counter_rng(6, q) % max_width);
+  switch ((r >> 8) % 8)
+    {
+    case 0:
+      return index.primes_in(lo, std::min(hi, lo + 4096)).size();
+    case 1:
+      return index.is_prime(centre);
+    case 2:
+      {
+        uint64_t k = index.count_primes(0, lo);   // the largest prime <= lo
+        return (k > 0) ? index.nth_prime(k) : 0;
+      }
+    default:
+      return index.count_primes(lo, hi);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc < 2 || argc > 5)
+    {
+      usage(argv[0]);
+    }
+  int threads;
+  uint64_t queries = 100000, limit = 1000000000, cache_segments = 1024;
+  try
+    {
+      threads = std::stoi(argv[1]);
+      if (argc >= 3)
+        {
+          queries = std::stoull(argv[2]);
+        }
+      if (argc >= 4)
+        {
+          limit = std::stoull(argv[3]);
+        }
+      if (argc >= 5)
+        {
+          cache_segments = std::stoull(argv[4]);
+        }
+    }
+  catch (std::exception const&)
+    {
+      usage(argv[0]);
+    }
+  if (threads < 1 || queries < 1 || limit < check_max)
+    {
+      usage(argv[0]);
+    }
+
+  {
+    PrimeIndex index(check_max);
+    if (!check(index))
+      {
+        std::cerr << "Mismatch against a plain sieve" << std::endl;
+        return 1;
+      }
+    std::cout << "Index agrees with a plain sieve up to " << check_max << std::endl;
+  }
+
+  // What a one-shot program pays for every query: sieving the whole range
+  double start = bench_now();
+  uint64_t total = PrimeIndex(limit, 1).count_primes(0, limit);
+  double full = bench_now() - start;
+  std::cout << "Full sieve: " << total << " primes up to " << limit << " in " << full << " s" << std::endl;
+
+  ThreadPool pool(threads);  // pinned as set by THREAD_PLACEMENT
+  PrimeIndex index(limit, cache_segments);
+  bench_config cfg = bench_config_get();
+  double *times = bench_times(&cfg);
+  uint64_t checksum = 0;
+  double cold = 0;
+  for (int rep=-cfg.warmups; rep<cfg.reps; ++rep)
+    {
+      std::atomic<uint64_t> sum(0);
+      start = bench_now();
+      pool.run([&](int i)
+        {
+          uint64_t local = 0;
+          for (uint64_t q=i; q<queries; q+=threads)
+            {
+              local += query(index, q);
+            }
+          sum.fetch_add(local, std::memory_order_relaxed);
+        });
+      double seconds = bench_now() - start;
+      bench_record(times, rep, seconds);
+      if (rep == -cfg.warmups)
+        {
+          cold = seconds;
+        }
+      checksum = sum.load();
+    }
+
+  std::string params = "threads=" + std::to_string(threads) + ",queries=" + std::to_string(queries)
+                       + ",limit=" + std::to_string(limit) + ",cache_segments=" + std::to_string(cache_segments);
+  bench_stats s = bench_report("prime_queries", params.c_str(), times, cfg.reps, double(queries), "queries/s");
+  if (!bench_machine_output())
+    {
+      std::cout << std::setprecision(4) << queries << " queries on " << threads << " threads: first pass " << cold
+                << " s, median " << s.median << " s, " << s.median / queries * 1e6 << " us/query ("
+                << full / (s.median / queries) << "x faster than a full sieve), checksum " << checksum << std::endl;
+      std::cout << "Cache: " << index.cache_hits() << " hits, " << index.cache_misses() << " misses, "
+                << index.segments_sieved() << " segments sieved" << std::endl;
+    }
+  free(times);
+  return 0;
+}
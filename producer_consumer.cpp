@@ -0,0 +1,293 @@
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <deque>
+#include <string>
+#include <vector>
+#include "ring_queue.hpp"
+#include "thread_pool.hpp"
+
+// non-determinism.cpp and shared-variable.cpp rewritten so that workers
+// hand their output to a single consumer through lock-free queues instead
+// of taking a shared mutex, plus a queue throughput benchmark.
+
+const size_t batch = 64;    // elements per batched push/pop
+const size_t capacity = 4096;
+
+typedef std::chrono::steady_clock Clock;
+
+double seconds_since(Clock::time_point start)
+{
+  std::chrono::duration<double> duration = Clock::now() - start;
+  return duration.count();
+}
+
+// Pushes all n values, waiting while the queue is full
+template <typename Queue, typename T>
+void push_all(Queue &queue, T const *values, size_t n, size_t chunk)
+{
+  for (size_t done=0, spin=0; done<n; )
+    {
+      size_t pushed = queue.push(values + done, std::min(chunk, n - done));
+      done += pushed;
+      spin = pushed > 0 ? 0 : spin + 1;
+      if (spin > 64)
+        {
+          std::this_thread::yield();
+        }
+    }
+}
+
+// Pops exactly n values, waiting while the queue is empty
+template <typename Queue, typename T, typename Consume>
+void pop_all(Queue &queue, T *buffer, size_t n, size_t chunk, Consume consume)
+{
+  for (size_t done=0, spin=0; done<n; )
+    {
+      size_t popped = queue.pop(buffer, std::min(chunk, n - done));
+      for (size_t i=0; i<popped; ++i)
+        {
+          consume(buffer[i]);
+        }
+      done += popped;
+      spin = popped > 0 ? 0 : spin + 1;
+      if (spin > 64)
+        {
+          std::this_thread::yield();
+        }
+    }
+}
+
+// non-determinism.cpp: every task reports that it runs and terminates;
+// only the consumer writes to std::cout
+struct Event
+{
+  int task;
+  bool terminating;
+};
+
+void tasks(int count)
+{
+  MpscQueue<Event> queue(capacity);
+  ThreadPool pool(count);
+  pool.start([&](int i)
+    {
+      Event running = { i + 1, false }, terminating = { i + 1, true };
+      push_all(queue, &running, 1, 1);
+      push_all(queue, &terminating, 1, 1);
+    });
+
+  Event events[batch];
+  pop_all(queue, events, 2 * count, batch, [](Event const &e)
+    {
+      std::cout << "Task " << e.task << (e.terminating ? " is terminating." : " is running.") << '\n';
+    });
+  std::cout.flush();
+  pool.wait();
+}
+
+// shared-variable.cpp: inc and dec send their updates to the consumer,
+// which owns x and prints it ten times a second
+void counter(double duration)
+{
+  SpscQueue<long> increments(capacity), decrements(capacity);
+  SpscQueue<long> *queues[] = { &increments, &decrements };
+  std::atomic<bool> run(true);
+  std::atomic<int> stopped(0);
+  ThreadPool pool(2);
+  pool.start([&](int i)
+    {
+      std::vector<long> deltas(batch, (i == 0) ? 1 : -1);
+      while (run.load(std::memory_order_relaxed))
+        {
+          push_all(*queues[i], deltas.data(), batch, batch);
+        }
+      stopped.fetch_add(1, std::memory_order_release);
+    });
+
+  long x = 0;
+  long buffer[batch];
+  auto drain = [&]
+    {
+      for (auto q : queues)
+        {
+          for (size_t n=q->pop(buffer, batch), i=0; i<n; ++i)
+            {
+              x += buffer[i];
+            }
+        }
+    };
+
+  Clock::time_point start = Clock::now(), printed = start;
+  while (seconds_since(start) < duration)
+    {
+      drain();
+      if (seconds_since(printed) >= 0.1)
+        {
+          std::cout << x << std::endl;
+          printed = Clock::now();
+        }
+    }
+
+  // keep draining so blocked producers can finish, then empty the queues
+  run = false;
+  while (stopped.load(std::memory_order_acquire) < 2)
+    {
+      drain();
+    }
+  pool.wait();
+  for (size_t i=0; i<capacity/batch + 1; ++i)
+    {
+      drain();
+    }
+  std::cout << x << std::endl;
+}
+
+// Baseline for the benchmark: std::deque guarded by a mutex
+template <typename T>
+class MutexQueue
+{
+public:
+  explicit MutexQueue(size_t capacity) : capacity(capacity) {}
+
+  size_t push(T const *values, size_t n)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    n = std::min(n, capacity - queue.size());
+    queue.insert(queue.end(), values, values + n);
+    return n;
+  }
+
+  size_t pop(T *values, size_t n)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    n = std::min(n, queue.size());
+    std::copy(queue.begin(), queue.begin() + n, values);
+    queue.erase(queue.begin(), queue.begin() + n);
+    return n;
+  }
+
+private:
+  const size_t capacity;
+  std::mutex mutex;
+  std::deque<T> queue;
+};
+
+// Millions of messages per second from pool.size() producers to one consumer
+template <typename Queue>
+double throughput(ThreadPool &pool, long messages, size_t chunk)
+{
+  Queue queue(capacity);
+  long per_producer = messages / pool.size();
+  Clock::time_point start = Clock::now();
+  pool.start([&](int)
+    {
+      long values[batch];
+      for (size_t i=0; i<batch; ++i)
+        {
+          values[i] = 1;
+        }
+      for (long sent=0; sent<per_producer; sent+=chunk)
+        {
+          push_all(queue, values, std::min<long>(chunk, per_producer - sent), chunk);
+        }
+    });
+
+  long sum = 0, buffer[batch];
+  pop_all(queue, buffer, per_producer * pool.size(), chunk, [&](long v) { sum += v; });
+  double seconds = seconds_since(start);
+  pool.wait();
+  if (sum != per_producer * pool.size())
+    {
+      std::cout << "Lost messages: received " << sum << " of " << per_producer * pool.size() << std::endl;
+    }
+  return sum / seconds * 1e-6;
+}
+
+void benchmark(int max_producers, long messages)
+{
+  std::cout << std::setw(10) << "producers" << std::setw(10) << "batch"
+            << std::setw(12) << "mutex" << std::setw(12) << "spsc" << std::setw(12) << "mpsc"
+            << "   (Mmsg/s)" << std::endl;
+  for (int producers=1; ; producers*=2)
+    {
+      producers = std::min(producers, max_producers);
+      ThreadPool pool(producers);
+      for (size_t chunk : { size_t(1), batch })
+        {
+          std::cout << std::setw(10) << producers << std::setw(10) << chunk << std::fixed << std::setprecision(2)
+                    << std::setw(12) << throughput<MutexQueue<long>>(pool, messages, chunk);
+          if (producers == 1)
+            {
+              std::cout << std::setw(12) << throughput<SpscQueue<long>>(pool, messages, chunk);
+            }
+          else
+            {
+              std::cout << std::setw(12) << "-";
+            }
+          std::cout << std::setw(12) << throughput<MpscQueue<long>>(pool, messages, chunk) << std::endl;
+        }
+      if (producers == max_producers)
+        {
+          break;
+        }
+    }
+}
+
+void usage(char *program)
+{
+  std::cout << "Usage: " << program << " mode [arguments]" << std::endl;
+  std::cout << std::endl;
+  std::cout << "  tasks [T]                  T tasks report to one printer (default 8)" << std::endl;
+  std::cout << "  counter [seconds]          inc and dec feed the thread owning x (default 1)" << std::endl;
+  std::cout << "  bench [P [messages]]       queue throughput for up to P producers" << std::endl;
+  exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc < 2 || argc > 4)
+    {
+      usage(argv[0]);
+    }
+
+  std::string mode = argv[1];
+  try
+    {
+      if (mode == "tasks" && argc <= 3)
+        {
+          int count = (argc == 3) ? std::stoi(argv[2]) : 8;
+          if (count < 1)
+            {
+              usage(argv[0]);
+            }
+          tasks(count);
+        }
+      else if (mode == "counter" && argc <= 3)
+        {
+          counter((argc == 3) ? std::stod(argv[2]) : 1.0);
+        }
+      else if (mode == "bench")
+        {
+          int producers = (argc >= 3) ? std::stoi(argv[2]) : 4;
+          long messages = (argc == 4) ? std::stol(argv[3]) : 10000000;
+          if (producers < 1 || messages < 1)
+            {
+              usage(argv[0]);
+            }
+          benchmark(producers, messages);
+        }
+      else
+        {
+          usage(argv[0]);
+        }
+    }
+  catch (std::exception const&)
+    {
+      usage(argv[0]);
+    }
+
+  return 0;
+}
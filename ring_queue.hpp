@@ -0,0 +1,188 @@
+// Bounded lock-free ring queues for handing work to a single consumer
+//
+//   SpscQueue<T>  one producer, one consumer. Head and tail live on their
+//                 own cache lines and each side caches the other's index,
+//                 so the shared lines are only read when the cached view
+//                 says the queue looks full or empty.
+//   MpscQueue<T>  many producers, one consumer. Every cell carries a
+//                 sequence number (Vyukov's bounded queue); producers claim
+//                 cells by compare-and-swap on the tail.
+//
+// Both have try_push/try_pop for one element and push/pop for batches,
+// which return how many elements were moved. Capacity is rounded up to a
+// power of two. T must be default constructible and copy assignable.
+
+#ifndef RING_QUEUE_HPP
+#define RING_QUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+inline size_t ring_capacity(size_t capacity)
+{
+  size_t n = 2;
+  while (n < capacity)
+    {
+      n *= 2;
+    }
+  return n;
+}
+
+template <typename T>
+class SpscQueue
+{
+public:
+  explicit SpscQueue(size_t capacity) : cells(ring_capacity(capacity)), mask(cells.size() - 1) {}
+
+  bool try_push(T const &value)
+  {
+    return push(&value, 1) == 1;
+  }
+
+  bool try_pop(T &value)
+  {
+    return pop(&value, 1) == 1;
+  }
+
+  // Appends up to n elements; returns how many fit
+  size_t push(T const *values, size_t n)
+  {
+    size_t tail = producer.index.load(std::memory_order_relaxed);
+    if (producer.cached + mask + 1 - tail < n)
+      {
+        producer.cached = consumer.index.load(std::memory_order_acquire);
+      }
+    size_t free = producer.cached + mask + 1 - tail;
+    n = (n < free) ? n : free;
+    for (size_t i=0; i<n; ++i)
+      {
+        cells[(tail + i) & mask] = values[i];
+      }
+    producer.index.store(tail + n, std::memory_order_release);
+    return n;
+  }
+
+  // Removes up to n elements; returns how many were available
+  size_t pop(T *values, size_t n)
+  {
+    size_t head = consumer.index.load(std::memory_order_relaxed);
+    if (consumer.cached - head < n)
+      {
+        consumer.cached = producer.index.load(std::memory_order_acquire);
+      }
+    size_t used = consumer.cached - head;
+    n = (n < used) ? n : used;
+    for (size_t i=0; i<n; ++i)
+      {
+        values[i] = cells[(head + i) & mask];
+      }
+    consumer.index.store(head + n, std::memory_order_release);
+    return n;
+  }
+
+private:
+  // Each side's index with its cached copy of the other side's index
+  struct alignas(64) Side
+  {
+    std::atomic<size_t> index{0};
+    size_t cached = 0;
+  };
+
+  std::vector<T> cells;
+  const size_t mask;
+  Side producer;
+  Side consumer;
+};
+
+template <typename T>
+class MpscQueue
+{
+public:
+  explicit MpscQueue(size_t capacity) : cells(ring_capacity(capacity)), mask(cells.size() - 1)
+  {
+    for (size_t i=0; i<cells.size(); ++i)
+      {
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+      }
+  }
+
+  bool try_push(T const &value)
+  {
+    return push(&value, 1) == 1;
+  }
+
+  bool try_pop(T &value)
+  {
+    return pop(&value, 1) == 1;
+  }
+
+  // Claims up to n consecutive cells and fills them; returns how many.
+  // The single consumer frees cells in order, so if the last cell of a
+  // range is free, the whole range is.
+  size_t push(T const *values, size_t n)
+  {
+    size_t pos = tail.load(std::memory_order_relaxed);
+    for (;;)
+      {
+        size_t k = n;
+        while (k > 0 && cells[(pos + k - 1) & mask].sequence.load(std::memory_order_acquire) != pos + k - 1)
+          {
+            k /= 2;
+          }
+        if (k == 0)
+          {
+            // full, unless another producer moved the tail meanwhile
+            size_t now = tail.load(std::memory_order_relaxed);
+            if (now == pos)
+              {
+                return 0;
+              }
+            pos = now;
+            continue;
+          }
+        if (tail.compare_exchange_weak(pos, pos + k, std::memory_order_relaxed))
+          {
+            for (size_t i=0; i<k; ++i)
+              {
+                Cell &cell = cells[(pos + i) & mask];
+                cell.value = values[i];
+                cell.sequence.store(pos + i + 1, std::memory_order_release);
+              }
+            return k;
+          }
+      }
+  }
+
+  // Removes up to n elements that are fully written; returns how many
+  size_t pop(T *values, size_t n)
+  {
+    size_t i = 0;
+    for (; i<n; ++i)
+      {
+        Cell &cell = cells[head & mask];
+        if (cell.sequence.load(std::memory_order_acquire) != head + 1)
+          {
+            break;
+          }
+        values[i] = cell.value;
+        cell.sequence.store(head + mask + 1, std::memory_order_release);
+        ++head;
+      }
+    return i;
+  }
+
+private:
+  struct Cell
+  {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+
+  std::vector<Cell> cells;
+  const size_t mask;
+  alignas(64) std::atomic<size_t> tail{0};
+  alignas(64) size_t head = 0;  // only touched by the consumer
+};
+
+#endif // RING_QUEUE_HPP
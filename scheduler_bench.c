@@ -0,0 +1,222 @@
+/* Work-stealing scheduler against the OpenMP schedules
+ * Inputs: Number of threads, optional number of iterations and mean work
+ *         per iteration (dependent floating-point steps)
+ * Outputs: Time of every workload under every schedule, and its speedup
+ *          over schedule(static)
+ *
+ * Workloads: uniform (every iteration costs the same), triangular (cost
+ * grows with the index, like a triangular solve) and irregular (one
+ * iteration in 64 costs 32 times the mean, like the live tiles of a sparse
+ * Life board). They run as parallel loops with schedule(static),
+ * schedule(dynamic, 1), schedule(dynamic, 64) and schedule(guided), and on
+ * ws_parallel_for(). The tree workload sums the irregular iterations by
+ * recursive halving, with OpenMP tasks and with ws_spawn()/ws_sync().
+ * Every schedule computes the same checksum.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include "bench.h"
+#include "counter_rng.h"
+#include "ws_sched.h"
+
+#define ITERATIONS 100000 /* Default loop length */
+#define WORK 200 /* Default mean steps per iteration */
+#define TREE_CUTOFF 64 /* Iterations below which the tree workload stops splitting */
+
+enum { UNIFORM, TRIANGULAR, IRREGULAR, WORKLOADS };
+static const char *workload_names[] = {"uniform", "triangular", "irregular"};
+
+typedef struct {
+    int workload;
+    long n, work;
+    double *out;
+} loop;
+
+/* Steps of iteration i; every workload averages about `work` */
+static long cost(const loop *l, long i) {
+    switch (l->workload) {
+    case TRIANGULAR: return 2 * l->work * i / l->n;
+    case IRREGULAR: return (counter_rng(1, i) % 64 == 0) ? 32 * l->work : l->work / 2;
+    default: return l->work;
+    }
+}
+
+/* A dependent chain the compiler can neither vectorize nor drop */
+static double spin(long i, long steps) {
+    double x = (double)i;
+    for (long s = 0; s < steps; s++) {
+        x = x * 0.999999 + 1.0;
+    }
+    return x;
+}
+
+static void loop_range(long begin, long end, void *arg) {
+    loop *l = arg;
+    for (long i = begin; i < end; i++) {
+        l->out[i] = spin(i, cost(l, i));
+    }
+}
+
+static void run_openmp(loop *l) {
+    #pragma omp parallel for schedule(runtime)
+    for (long i = 0; i < l->n; i++) {
+        l->out[i] = spin(i, cost(l, i));
+    }
+}
+
+/* Tree workload: the sum of the irregular iterations in [begin, end) */
+typedef struct {
+    loop *l;
+    long begin, end;
+    double sum;
+} tree;
+
+static double tree_leaf(tree *t) {
+    double sum = 0;
+    for (long i = t->begin; i < t->end; i++) {
+        sum += spin(i, cost(t->l, i));
+    }
+    return sum;
+}
+
+static void tree_openmp(tree *t) {
+    if (t->end - t->begin <= TREE_CUTOFF) {
+        t->sum = tree_leaf(t);
+        return;
+    }
+    long middle = t->begin + (t->end - t->begin) / 2;
+    tree left = {t->l, t->begin, middle, 0}, right = {t->l, middle, t->end, 0};
+    #pragma omp task shared(left)
+    tree_openmp(&left);
+    tree_openmp(&right);
+    #pragma omp taskwait
+    t->sum = left.sum + right.sum;
+}
+
+static void tree_ws(void *arg) {
+    tree *t = arg;
+    if (t->end - t->begin <= TREE_CUTOFF) {
+        t->sum = tree_leaf(t);
+        return;
+    }
+    long middle = t->begin + (t->end - t->begin) / 2;
+    tree left = {t->l, t->begin, middle, 0}, right = {t->l, middle, t->end, 0};
+    ws_group g = WS_GROUP_INIT;
+    ws_spawn(&g, tree_ws, &left);
+    tree_ws(&right);
+    ws_sync(&g);
+    t->sum = left.sum + right.sum;
+}
+
+/* The loop schedules; "ws" is the work-stealing scheduler */
+typedef struct {
+    const char *name;
+    omp_sched_t kind;
+    int chunk;
+} schedule;
+
+static const schedule schedules[] = {
+    {"static", omp_sched_static, 0},
+    {"dynamic-1", omp_sched_dynamic, 1},
+    {"dynamic-64", omp_sched_dynamic, 64},
+    {"guided", omp_sched_guided, 0},
+    {"ws", (omp_sched_t)0, 0},
+};
+#define SCHEDULES (int)(sizeof(schedules) / sizeof(schedules[0]))
+
+static double checksum(const loop *l) {
+    double sum = 0;
+    for (long i = 0; i < l->n; i++) sum += l->out[i];
+    return sum;
+}
+
+/* Reports one configuration; returns the median time */
+static double report(const char *workload, const char *schedule, int threads, long n, long work,
+                     const double *times, int reps, double baseline, double sum) {
+    char params[128];
+    snprintf(params, sizeof(params), "workload=%s,schedule=%s,threads=%d,n=%ld,work=%ld",
+             workload, schedule, threads, n, work);
+    bench_stats s = bench_summarize(times, reps);
+    if (bench_machine_output()) {
+        bench_report("scheduler_bench", params, times, reps, n, "iterations/s");
+    } else {
+        printf("%-11s %-11s %12.6f %8.2f %18.6e\n", workload, schedule, s.median,
+               (baseline > 0 && s.median > 0) ? baseline / s.median : 1.0, sum);
+    }
+    return s.median;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2 || argc > 4) {
+        printf("Usage: %s <num_threads> [iterations [work]]\n", argv[0]);
+        return -1;
+    }
+
+    int threads = atoi(argv[1]);
+    long n = (argc >= 3) ? atol(argv[2]) : ITERATIONS;
+    long work = (argc >= 4) ? atol(argv[3]) : WORK;
+    if (threads < 1 || n < 1 || work < 1) {
+        printf("Error: threads, iterations and work should be positive.\n");
+        return -1;
+    }
+
+    bench_config cfg = bench_config_get();
+    double *times = bench_times(&cfg);
+    loop l = {UNIFORM, n, work, malloc(n * sizeof(double))};
+
+    omp_set_num_threads(threads);
+    ws_start(threads);
+    if (!bench_machine_output()) {
+        printf("%-11s %-11s %12s %8s %18s\n", "workload", "schedule", "median (s)", "speedup", "checksum");
+    }
+
+    for (l.workload = 0; l.workload < WORKLOADS; l.workload++) {
+        double baseline = 0;
+        for (int s = 0; s < SCHEDULES; s++) {
+            int ws = strcmp(schedules[s].name, "ws") == 0;
+            if (!ws) omp_set_schedule(schedules[s].kind, schedules[s].chunk);
+            for (int rep = -cfg.warmups; rep < cfg.reps; rep++) {
+                memset(l.out, 0, n * sizeof(double));
+                double start = bench_now();
+                if (ws) {
+                    ws_parallel_for(0, n, 0, loop_range, &l);
+                } else {
+                    run_openmp(&l);
+                }
+                bench_record(times, rep, bench_now() - start);
+            }
+            double median = report(workload_names[l.workload], schedules[s].name, threads, n, work,
+                                   times, cfg.reps, baseline, checksum(&l));
+            if (s == 0) baseline = median;
+        }
+    }
+
+    // Spawn/sync against OpenMP tasks on the irregular costs
+    l.workload = IRREGULAR;
+    double baseline = 0, sum = 0;
+    for (int ws = 0; ws <= 1; ws++) {
+        for (int rep = -cfg.warmups; rep < cfg.reps; rep++) {
+            tree root = {&l, 0, n, 0};
+            double start = bench_now();
+            if (ws) {
+                tree_ws(&root);
+            } else {
+                #pragma omp parallel
+                #pragma omp single
+                tree_openmp(&root);
+            }
+            bench_record(times, rep, bench_now() - start);
+            sum = root.sum;
+        }
+        double median = report("tree", ws ? "ws" : "omp-tasks", threads, n, work, times, cfg.reps, baseline, sum);
+        if (!ws) baseline = median;
+    }
+
+    ws_stop();
+    free(l.out);
+    free(times);
+    return 0;
+}
@@ -1,64 +1,124 @@
 #include <iostream>
+#include <iomanip>
 #include <thread>
-#include <mutex>
+#include <algorithm>
 #include <chrono>
+#include <string>
+#include "counters.hpp"
+#include "thread_pool.hpp"
 
-std::mutex mutex;
-
-long x = 0;
-bool run = true;
+// Writers only touch their own shard, so printing never blocks them
+ShardedCounter x;
+std::atomic<bool> run(true);
 
 void inc()
 {
-  bool r = true;
-  while (r)
+  while (run.load(std::memory_order_relaxed))
     {
-      mutex.lock();
-      ++x;
-      r = run;
-      mutex.unlock();
+      x.add(1);
     }
 }
 
 void dec()
 {
-  bool r = true;
-  while (r)
+  while (run.load(std::memory_order_relaxed))
     {
-      mutex.lock();
-      --x;
-      r = run;
-      mutex.unlock();
+      x.add(-1);
     }
 }
 
 void print()
 {
-  bool r = true;
-  while (r)
+  while (run.load(std::memory_order_relaxed))
     {
-      mutex.lock();
-      std::cout << x << std::endl;
-      r = run;
-      mutex.unlock();
+      std::cout << x.value() << std::endl;
+    }
+}
+
+typedef std::chrono::steady_clock Clock;
+
+// Millions of add() calls per second with every worker updating one counter
+template <typename Counter>
+double contention(ThreadPool &pool, long ops)
+{
+  Counter counter;
+  Clock::time_point start = Clock::now();
+  pool.run([&](int i)
+    {
+      long delta = (i % 2 == 0) ? 1 : -1;
+      for (long n=0; n<ops; ++n)
+        {
+          counter.add(delta);
+        }
+    });
+  std::chrono::duration<double> seconds = Clock::now() - start;
+  long expected = (pool.size() % 2 == 0) ? 0 : ops;
+  if (counter.value() != expected)
+    {
+      std::cout << "Counter mismatch: " << counter.value() << " instead of " << expected << std::endl;
+    }
+  return ops * pool.size() / seconds.count() * 1e-6;
+}
+
+void benchmark(int max_threads, long ops)
+{
+  std::cout << std::setw(8) << "threads" << std::setw(12) << "mutex" << std::setw(12) << "atomic"
+            << std::setw(12) << "sharded" << std::setw(12) << "combining" << "   (Mops/s)" << std::endl;
+  // powers of two, then max_threads itself
+  for (int threads=1; ; threads*=2)
+    {
+      threads = std::min(threads, max_threads);
+      ThreadPool pool(threads);
+      std::cout << std::setw(8) << threads << std::fixed << std::setprecision(2)
+                << std::setw(12) << contention<MutexCounter>(pool, ops)
+                << std::setw(12) << contention<AtomicCounter>(pool, ops)
+                << std::setw(12) << contention<ShardedCounter>(pool, ops)
+                << std::setw(12) << contention<CombiningCounter>(pool, ops) << std::endl;
+      if (threads == max_threads)
+        {
+          break;
+        }
     }
 }
 
 int main(int argc, char *argv[], char* envp[])
 {
-  std::thread t1(inc);
-  std::thread t2(dec);
-  std::thread t3(print);
+  if (argc > 1)
+    {
+      // bench <max_threads> [ops per thread]
+      int max_threads = 0;
+      long ops = 1000000;
+      try
+        {
+          if (std::string(argv[1]) == "bench" && argc >= 3 && argc <= 4)
+            {
+              max_threads = std::stoi(argv[2]);
+              ops = (argc == 4) ? std::stol(argv[3]) : ops;
+            }
+        }
+      catch (std::exception const&)
+        {
+          max_threads = 0;
+        }
+      if (max_threads < 1)
+        {
+          std::cout << "Usage: " << argv[0] << " [bench <max_threads> [ops_per_thread]]" << std::endl;
+          return 1;
+        }
+      benchmark(max_threads, ops);
+      return 0;
+    }
+
+  ThreadPool pool(3);
+  void (*tasks[])() = { inc, dec, print };
+
+  pool.start([&](int i) { tasks[i](); });
 
   std::this_thread::sleep_for(std::chrono::seconds(1));
 
-  mutex.lock();
   run = false;
-  mutex.unlock();
 
-  t1.join();
-  t2.join();
-  t3.join();
+  pool.wait();
 
   return 0;
 }
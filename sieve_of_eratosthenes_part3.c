@@ -2,13 +2,15 @@
 #include <stdlib.h>
 #include <math.h>
 #include <mpi.h>
+#include "bench.h"
+#include "perf_region.h"
 
 #define MAX 1000000
 #define MAX_NAME_SIZE 42
 
 int main(int argc, char* argv[]) {
     int sqrt_max = (int)sqrt(MAX);
-    int rank, size, len, count = 0;
+    int rank, size, len;
     char name[MAX_NAME_SIZE];
     int mpi_root = 0;  // Rank 0 is the master
 
@@ -17,7 +19,14 @@ int main(int argc, char* argv[]) {
     MPI_Comm_size(MPI_COMM_WORLD, &size);
     MPI_Get_processor_name(name, &len);
 
-    double start_time, end_time, local_elapsed, global_elapsed;
+    bench_config cfg = bench_config_get();
+    double *times = bench_times(&cfg);
+
+    // Hardware counters of this rank's marking loops, with PERF_REGIONS set
+    char region_name[32];
+    perf_region region;
+    snprintf(region_name, sizeof(region_name), "sieve_mark rank=%d", rank);
+    perf_region_init(&region, region_name);
 
     // Initialize seeds
     int* seeds = (int*)malloc((sqrt_max + 1) * sizeof(int));
@@ -40,9 +49,6 @@ int main(int argc, char* argv[]) {
     // Broadcast the seeds to all processes
     MPI_Bcast(seeds, sqrt_max + 1, MPI_INT, mpi_root, MPI_COMM_WORLD);
 
-    // Start timing after receiving the seeds
-    start_time = MPI_Wtime();
-
     // Divide the remaining range [sqrt(MAX) + 1, MAX] among processes
     int total_range_size = MAX - sqrt_max;
     int base_range_size = total_range_size / size;
@@ -57,26 +63,9 @@ int main(int argc, char* argv[]) {
         end = start + base_range_size - 1;
     }
 
-    // Mark non-primes in the assigned range
     int range_size = end - start + 1;
     int* range_prime_array = (int*)malloc(range_size * sizeof(int));
-    for (int i = 0; i < range_size; i++) {
-        range_prime_array[i] = 1;
-    }
-
-    // Use primes up to sqrt(MAX) to mark non-primes in the range
-    for (int i = 2; i <= sqrt_max; ++i) {
-        if (seeds[i]) {
-            int p = i;
-            int first_multiple = ((start + p - 1) / p) * p;
-            if (first_multiple < start) first_multiple = p * p;
-            for (int j = first_multiple; j <= end; j += p) {
-                range_prime_array[j - start] = 0;
-            }
-        }
-    }
 
-    // Gather the results at process 0 using MPI_Gather
     int* final_primes = NULL;
     if (rank == mpi_root) {
         final_primes = (int*)malloc((MAX + 1) * sizeof(int));
@@ -86,15 +75,38 @@ int main(int argc, char* argv[]) {
         }
     }
 
-    // Gather the results from all processes
-    MPI_Gather(range_prime_array, range_size, MPI_INT, &final_primes[start], range_size, MPI_INT, mpi_root, MPI_COMM_WORLD);
+    for (int rep = -cfg.warmups; rep < cfg.reps; rep++) {
+        // Start timing after receiving the seeds
+        MPI_Barrier(MPI_COMM_WORLD);
+        double start_time = bench_now();
+
+        perf_region_begin(&region);
+        // Mark non-primes in the assigned range
+        for (int i = 0; i < range_size; i++) {
+            range_prime_array[i] = 1;
+        }
+
+        // Use primes up to sqrt(MAX) to mark non-primes in the range
+        for (int i = 2; i <= sqrt_max; ++i) {
+            if (seeds[i]) {
+                int p = i;
+                int first_multiple = ((start + p - 1) / p) * p;
+                if (first_multiple < start) first_multiple = p * p;
+                for (int j = first_multiple; j <= end; j += p) {
+                    range_prime_array[j - start] = 0;
+                }
+            }
+        }
+        perf_region_end(&region);
 
-    // Stop the timer
-    end_time = MPI_Wtime();
-    local_elapsed = end_time - start_time;
+        // Gather the results from all processes
+        MPI_Gather(range_prime_array, range_size, MPI_INT, &final_primes[start], range_size, MPI_INT, mpi_root, MPI_COMM_WORLD);
 
-    // Reduce the timing results to the master process
-    MPI_Reduce(&local_elapsed, &global_elapsed, 1, MPI_DOUBLE, MPI_MAX, mpi_root, MPI_COMM_WORLD);
+        // Stop the timer and keep the slowest process's time
+        double local_elapsed = bench_now() - start_time, global_elapsed = 0;
+        MPI_Reduce(&local_elapsed, &global_elapsed, 1, MPI_DOUBLE, MPI_MAX, mpi_root, MPI_COMM_WORLD);
+        bench_record(times, rep, global_elapsed);
+    }
 
     if (rank == mpi_root) {
         // Print the final list of primes (a subset for demonstration)
@@ -103,15 +115,24 @@ int main(int argc, char* argv[]) {
             if (final_primes[i]) printf("%d ", i);
         }
         printf("\n");
-        printf("Max Execution Time among all processes: %0.12f seconds\n", global_elapsed);
+        int primes = 0;
+        for (int i = 2; i <= MAX; ++i) primes += final_primes[i];
+        char params[64];
+        snprintf(params, sizeof(params), "N=%d,ranks=%d", MAX, size);
+        bench_stats stats = bench_report("sieve_of_eratosthenes_part3", params, times, cfg.reps, primes, "primes/s");
+        printf("Max Execution Time among all processes: %0.12f seconds\n", stats.median);
 
         free(final_primes);
     }
 
+    perf_region_report(&region, range_size, "candidate", 0);
+    perf_region_close(&region);
+
     // Finalize MPI and free allocated memory
     MPI_Finalize();
     free(seeds);
     free(range_prime_array);
+    free(times);
 
     return 0;
 }
@@ -0,0 +1,147 @@
+/* Sparse Matrix Multiplication (CSR SpMV and SpGEMM) using OpenMP
+ * Inputs: Number of threads, and either a matrix size (random matrices at
+ *         several densities, compared with the dense blocked GEMM) or a
+ *         Matrix Market file (computes A * x and A * A)
+ * Outputs: Execution times, nonzeros and a check against the dense result
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <omp.h>
+#include "counter_rng.h"
+#include "gemm_u16.h"
+#include "sparse_matrix.h"
+
+static const double densities[] = {0.0001, 0.001, 0.01, 0.05, 0.1, 0.3};
+
+/* Random N x N matrix with the given density and values between 1 and 256 */
+static csr_matrix random_sparse(int N, double density, uint64_t seed) {
+    long target = (long)(density * N * N), count = 0;
+    coo_entry *entries = malloc((target > 0 ? target : 1) * sizeof(coo_entry));
+    for (long e = 0; e < target; e++) {
+        uint64_t r = counter_rng(seed, e);
+        entries[count++] = (coo_entry){(int)(r % N), (int)((r >> 20) % N), (double)(r >> 56) + 1};
+    }
+    csr_matrix A = csr_from_coo(N, N, entries, count);
+    free(entries);
+    return A;
+}
+
+/* Dense uint16 copy of a CSR matrix (values must fit in 16 bits) */
+static uint16_t *to_dense(const csr_matrix *A) {
+    uint16_t *D = gemm_alloc((size_t)A->rows * A->cols * sizeof(uint16_t));
+    memset(D, 0, (size_t)A->rows * A->cols * sizeof(uint16_t));
+    for (int i = 0; i < A->rows; i++) {
+        for (long p = A->row_ptr[i]; p < A->row_ptr[i + 1]; p++) {
+            D[(size_t)i * A->cols + A->col_idx[p]] = (uint16_t)A->val[p];
+        }
+    }
+    return D;
+}
+
+/* Compares C with a dense result; returns the number of differing entries */
+static long compare_dense(const csr_matrix *C, const uint32_t *D) {
+    long errors = 0;
+    for (int i = 0; i < C->rows; i++) {
+        long p = C->row_ptr[i];
+        for (int j = 0; j < C->cols; j++) {
+            double sparse = (p < C->row_ptr[i + 1] && C->col_idx[p] == j) ? C->val[p++] : 0;
+            if (sparse != (double)D[(size_t)i * C->cols + j]) errors++;
+        }
+    }
+    return errors;
+}
+
+/* Sweeps densities for random N x N matrices, sparse vs dense */
+static void benchmark_densities(int N) {
+    double *x = malloc(N * sizeof(double)), *y = malloc(N * sizeof(double));
+    uint32_t *D = gemm_alloc((size_t)N * N * sizeof(uint32_t));
+    for (int i = 0; i < N; i++) x[i] = 1;
+
+    printf("%10s %12s %12s %12s %12s %12s\n", "density", "nnz(A)", "nnz(C)", "SpMV (s)", "SpGEMM (s)", "dense (s)");
+    for (size_t d = 0; d < sizeof(densities) / sizeof(densities[0]); d++) {
+        csr_matrix A = random_sparse(N, densities[d], 2 * d + 1);
+        csr_matrix B = random_sparse(N, densities[d], 2 * d + 2);
+
+        double start_time = omp_get_wtime();
+        csr_spmv(&A, x, y);
+        double spmv_time = omp_get_wtime() - start_time;
+
+        start_time = omp_get_wtime();
+        csr_matrix C = csr_spgemm(&A, &B);
+        double spgemm_time = omp_get_wtime() - start_time;
+
+        uint16_t *A_dense = to_dense(&A), *B_dense = to_dense(&B);
+        start_time = omp_get_wtime();
+        gemm_u16(N, N, N, A_dense, N, B_dense, N, D, N);
+        double dense_time = omp_get_wtime() - start_time;
+
+        printf("%10g %12ld %12ld %12.6f %12.6f %12.6f\n",
+               densities[d], A.nnz, C.nnz, spmv_time, spgemm_time, dense_time);
+        long errors = compare_dense(&C, D);
+        if (errors > 0) {
+            printf("Mismatch found in %ld entries between the sparse and dense products\n", errors);
+        }
+
+        free(A_dense);
+        free(B_dense);
+        csr_free(&A);
+        csr_free(&B);
+        csr_free(&C);
+    }
+
+    free(x);
+    free(y);
+    free(D);
+}
+
+/* Loads a Matrix Market file and times A * x and A * A */
+static int benchmark_file(const char *path) {
+    csr_matrix A;
+    if (mm_read(path, &A) != 0) {
+        printf("Error: could not read the Matrix Market file %s\n", path);
+        return -1;
+    }
+    printf("%s: %d x %d, %ld nonzeros\n", path, A.rows, A.cols, A.nnz);
+
+    double *x = malloc(A.cols * sizeof(double)), *y = malloc(A.rows * sizeof(double));
+    for (int i = 0; i < A.cols; i++) x[i] = 1;
+    double start_time = omp_get_wtime();
+    csr_spmv(&A, x, y);
+    printf("SpMV execution time: %f seconds\n", omp_get_wtime() - start_time);
+
+    if (A.rows == A.cols) {
+        start_time = omp_get_wtime();
+        csr_matrix C = csr_spgemm(&A, &A);
+        printf("SpGEMM (A * A) execution time: %f seconds, %ld nonzeros\n", omp_get_wtime() - start_time, C.nnz);
+        csr_free(&C);
+    }
+
+    free(x);
+    free(y);
+    csr_free(&A);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        printf("Usage: %s <num_threads> <N | matrix.mtx>\n", argv[0]);
+        return -1;
+    }
+
+    int num_threads = atoi(argv[1]);
+    omp_set_num_threads(num_threads);
+
+    char *end;
+    int N = strtol(argv[2], &end, 10);
+    if (*end != '\0') {
+        return benchmark_file(argv[2]) == 0 ? 0 : -1;
+    }
+    if (N < 1) {
+        printf("Error: N should be positive.\n");
+        return -1;
+    }
+
+    benchmark_densities(N);
+    return 0;
+}
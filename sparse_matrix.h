@@ -0,0 +1,275 @@
+/* Sparse matrices in compressed sparse row (CSR) form
+ * A CSC matrix is stored as the CSR form of its transpose, so csr_transpose
+ * converts between the two layouts.
+ *
+ * SpMV and SpGEMM are parallelised over rows with OpenMP. SpGEMM uses
+ * Gustavson's row-wise algorithm in two passes: a symbolic pass counts the
+ * nonzeros of every row of C, then a numeric pass fills them in. Each thread
+ * keeps a dense accumulator with one slot per column of B plus a list of
+ * the columns it touched, so clearing it costs only the touched entries.
+*/
+
+#ifndef SPARSE_MATRIX_H
+#define SPARSE_MATRIX_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <omp.h>
+
+typedef struct {
+    int rows, cols;
+    long nnz;
+    long *row_ptr; /* rows + 1 offsets into col_idx and val */
+    int *col_idx;  /* sorted within each row */
+    double *val;
+} csr_matrix;
+
+/* One nonzero in coordinate (COO) form */
+typedef struct {
+    int row, col;
+    double val;
+} coo_entry;
+
+static inline csr_matrix csr_alloc(int rows, int cols, long nnz) {
+    csr_matrix A;
+    A.rows = rows;
+    A.cols = cols;
+    A.nnz = nnz;
+    A.row_ptr = calloc(rows + 1, sizeof(long));
+    A.col_idx = malloc((nnz > 0 ? nnz : 1) * sizeof(int));
+    A.val = malloc((nnz > 0 ? nnz : 1) * sizeof(double));
+    return A;
+}
+
+static inline void csr_free(csr_matrix *A) {
+    free(A->row_ptr);
+    free(A->col_idx);
+    free(A->val);
+    A->row_ptr = NULL;
+    A->col_idx = NULL;
+    A->val = NULL;
+}
+
+static int compare_int(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+/* Builds a CSR matrix from unordered entries; duplicates are summed */
+static inline csr_matrix csr_from_coo(int rows, int cols, const coo_entry *entries, long count) {
+    csr_matrix T = csr_alloc(rows, cols, count);
+
+    // Bucket the entries by row (counting sort)
+    for (long e = 0; e < count; e++) T.row_ptr[entries[e].row + 1]++;
+    for (int i = 0; i < rows; i++) T.row_ptr[i + 1] += T.row_ptr[i];
+    long *next = malloc((rows + 1) * sizeof(long));
+    memcpy(next, T.row_ptr, (rows + 1) * sizeof(long));
+    for (long e = 0; e < count; e++) {
+        long pos = next[entries[e].row]++;
+        T.col_idx[pos] = entries[e].col;
+        T.val[pos] = entries[e].val;
+    }
+    free(next);
+
+    // Sort each row by column and merge duplicates
+    csr_matrix A = csr_alloc(rows, cols, count);
+    long nnz = 0;
+    int *order = malloc((cols > 0 ? cols : 1) * sizeof(int));
+    double *sum = calloc(cols > 0 ? cols : 1, sizeof(double));
+    char *seen = calloc(cols > 0 ? cols : 1, 1);
+    for (int i = 0; i < rows; i++) {
+        int n = 0;
+        for (long p = T.row_ptr[i]; p < T.row_ptr[i + 1]; p++) {
+            int c = T.col_idx[p];
+            if (!seen[c]) {
+                seen[c] = 1;
+                order[n++] = c;
+            }
+            sum[c] += T.val[p];
+        }
+        qsort(order, n, sizeof(int), compare_int);
+        for (int k = 0; k < n; k++) {
+            A.col_idx[nnz] = order[k];
+            A.val[nnz++] = sum[order[k]];
+            sum[order[k]] = 0;
+            seen[order[k]] = 0;
+        }
+        A.row_ptr[i + 1] = nnz;
+    }
+    A.nnz = nnz;
+    free(order);
+    free(sum);
+    free(seen);
+    csr_free(&T);
+    return A;
+}
+
+/* Returns A^T in CSR form, which is also A in CSC form */
+static inline csr_matrix csr_transpose(const csr_matrix *A) {
+    csr_matrix T = csr_alloc(A->cols, A->rows, A->nnz);
+    for (long p = 0; p < A->nnz; p++) T.row_ptr[A->col_idx[p] + 1]++;
+    for (int j = 0; j < A->cols; j++) T.row_ptr[j + 1] += T.row_ptr[j];
+    long *next = malloc((A->cols + 1) * sizeof(long));
+    memcpy(next, T.row_ptr, (A->cols + 1) * sizeof(long));
+    // Rows of A are visited in order, so each row of T comes out sorted
+    for (int i = 0; i < A->rows; i++) {
+        for (long p = A->row_ptr[i]; p < A->row_ptr[i + 1]; p++) {
+            long pos = next[A->col_idx[p]]++;
+            T.col_idx[pos] = i;
+            T.val[pos] = A->val[p];
+        }
+    }
+    free(next);
+    return T;
+}
+
+/* y = A * x */
+static inline void csr_spmv(const csr_matrix *A, const double *x, double *y) {
+    #pragma omp parallel for schedule(dynamic, 256)
+    for (int i = 0; i < A->rows; i++) {
+        double sum = 0;
+        for (long p = A->row_ptr[i]; p < A->row_ptr[i + 1]; p++) {
+            sum += A->val[p] * x[A->col_idx[p]];
+        }
+        y[i] = sum;
+    }
+}
+
+/* C = A * B (Gustavson, two passes) */
+static inline csr_matrix csr_spgemm(const csr_matrix *A, const csr_matrix *B) {
+    csr_matrix C;
+    C.rows = A->rows;
+    C.cols = B->cols;
+    C.row_ptr = calloc(A->rows + 1, sizeof(long));
+
+    // Symbolic pass: number of distinct columns in every row of C
+    #pragma omp parallel
+    {
+        int *marker = malloc((B->cols > 0 ? B->cols : 1) * sizeof(int));
+        for (int j = 0; j < B->cols; j++) marker[j] = -1;
+
+        #pragma omp for schedule(dynamic, 64)
+        for (int i = 0; i < A->rows; i++) {
+            long count = 0;
+            for (long p = A->row_ptr[i]; p < A->row_ptr[i + 1]; p++) {
+                int k = A->col_idx[p];
+                for (long q = B->row_ptr[k]; q < B->row_ptr[k + 1]; q++) {
+                    if (marker[B->col_idx[q]] != i) {
+                        marker[B->col_idx[q]] = i;
+                        count++;
+                    }
+                }
+            }
+            C.row_ptr[i + 1] = count;
+        }
+        free(marker);
+    }
+
+    for (int i = 0; i < A->rows; i++) C.row_ptr[i + 1] += C.row_ptr[i];
+    C.nnz = C.row_ptr[A->rows];
+    C.col_idx = malloc((C.nnz > 0 ? C.nnz : 1) * sizeof(int));
+    C.val = malloc((C.nnz > 0 ? C.nnz : 1) * sizeof(double));
+
+    // Numeric pass: accumulate each row densely, then emit it in column order
+    #pragma omp parallel
+    {
+        double *acc = calloc(B->cols > 0 ? B->cols : 1, sizeof(double));
+        char *used = calloc(B->cols > 0 ? B->cols : 1, 1);
+
+        #pragma omp for schedule(dynamic, 64)
+        for (int i = 0; i < A->rows; i++) {
+            int *cols = &C.col_idx[C.row_ptr[i]];
+            int n = 0;
+            for (long p = A->row_ptr[i]; p < A->row_ptr[i + 1]; p++) {
+                int k = A->col_idx[p];
+                double a = A->val[p];
+                for (long q = B->row_ptr[k]; q < B->row_ptr[k + 1]; q++) {
+                    int j = B->col_idx[q];
+                    if (!used[j]) {
+                        used[j] = 1;
+                        cols[n++] = j;
+                    }
+                    acc[j] += a * B->val[q];
+                }
+            }
+            qsort(cols, n, sizeof(int), compare_int);
+            for (int c = 0; c < n; c++) {
+                C.val[C.row_ptr[i] + c] = acc[cols[c]];
+                acc[cols[c]] = 0;
+                used[cols[c]] = 0;
+            }
+        }
+        free(acc);
+        free(used);
+    }
+
+    return C;
+}
+
+/* Reads a Matrix Market coordinate file (real, integer or pattern; general
+ * or symmetric). Returns 0 on success and -1 if the file cannot be used. */
+static inline int mm_read(const char *path, csr_matrix *A) {
+    char line[1024], object[64], format[64], field[64], symmetry[64];
+    FILE *f = fopen(path, "r");
+    if (f == NULL) return -1;
+
+    if (fgets(line, sizeof(line), f) == NULL ||
+        sscanf(line, "%%%%MatrixMarket %63s %63s %63s %63s", object, format, field, symmetry) != 4) {
+        fclose(f);
+        return -1;
+    }
+    char *tokens[4] = {object, format, field, symmetry};
+    for (int t = 0; t < 4; t++) {
+        for (char *c = tokens[t]; *c != '\0'; c++) *c = tolower((unsigned char)*c);
+    }
+    int pattern = strcmp(field, "pattern") == 0;
+    int skew = strcmp(symmetry, "skew-symmetric") == 0;
+    int symmetric = skew || strcmp(symmetry, "symmetric") == 0;
+    if (strcmp(object, "matrix") != 0 || strcmp(format, "coordinate") != 0 ||
+        (!pattern && strcmp(field, "real") != 0 && strcmp(field, "integer") != 0) ||
+        (!symmetric && strcmp(symmetry, "general") != 0)) {
+        fclose(f);
+        return -1;
+    }
+
+    // Skip comments up to the size line
+    int rows, cols;
+    long count;
+    do {
+        if (fgets(line, sizeof(line), f) == NULL) {
+            fclose(f);
+            return -1;
+        }
+    } while (line[0] == '%');
+    if (sscanf(line, "%d %d %ld", &rows, &cols, &count) != 3) {
+        fclose(f);
+        return -1;
+    }
+
+    coo_entry *entries = malloc((symmetric ? 2 * count : count) * sizeof(coo_entry) + 1);
+    long n = 0;
+    for (long e = 0; e < count; e++) {
+        int i, j;
+        double v = 1;
+        if (fgets(line, sizeof(line), f) == NULL ||
+            sscanf(line, pattern ? "%d %d" : "%d %d %lf", &i, &j, &v) != (pattern ? 2 : 3) ||
+            i < 1 || i > rows || j < 1 || j > cols) {
+            free(entries);
+            fclose(f);
+            return -1;
+        }
+        entries[n++] = (coo_entry){i - 1, j - 1, v};
+        if (symmetric && i != j) {
+            entries[n++] = (coo_entry){j - 1, i - 1, skew ? -v : v};
+        }
+    }
+    fclose(f);
+
+    *A = csr_from_coo(rows, cols, entries, n);
+    free(entries);
+    return 0;
+}
+
+#endif /* SPARSE_MATRIX_H */
@@ -0,0 +1,385 @@
+// Persistent thread pool with CPU pinning
+//
+// Workers are created and pinned once, then reused for every parallel
+// phase, so runs do not pay for thread creation and the scheduler cannot
+// migrate workers between cores or sockets. Placement is chosen with the
+// THREAD_PLACEMENT environment variable:
+//
+//   cores    one worker per physical core, then the SMT siblings of the
+//            cores in the same order, then wrap around (default)
+//   compact  fill the hardware threads of a core, then the next core
+//   scatter  spread over sockets first, then over cores, then SMT siblings
+//   none     no pinning
+//   0,2,8-11 an explicit CPU list (for sched_setaffinity)
+//
+// Worker i runs on the i-th CPU of the chosen order, modulo its length.
+
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
+
+// Busy-wait hint for the spinning loops below
+inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#else
+  std::this_thread::yield();
+#endif
+}
+
+// Spins on a condition, yielding the CPU once it has spun `spins` times
+template <typename Condition>
+void spin_until(Condition done, int spins = 4096)
+{
+  for (int spin=0; !done(); ++spin)
+    {
+      if (spin < spins)
+        {
+          cpu_relax();
+        }
+      else
+        {
+          std::this_thread::yield();
+        }
+    }
+}
+
+// Sense-reversing spin barrier
+class Barrier
+{
+public:
+  explicit Barrier(int parties, int spins = 4096) : parties(parties), spins(spins), waiting(0), phase(0) {}
+
+  void wait()
+  {
+    int p = phase.load(std::memory_order_acquire);
+    if (waiting.fetch_add(1, std::memory_order_acq_rel) == parties - 1)
+      {
+        waiting.store(0, std::memory_order_relaxed);
+        phase.store(p + 1, std::memory_order_release);
+      }
+    else
+      {
+        spin_until([&] { return phase.load(std::memory_order_acquire) != p; }, spins);
+      }
+  }
+
+private:
+  const int parties;
+  const int spins;
+  alignas(64) std::atomic<int> waiting;
+  alignas(64) std::atomic<int> phase;
+};
+
+class Placement
+{
+public:
+  enum Policy { NONE, COMPACT, SCATTER, CORES, LIST };
+
+  static Placement from_env()
+  {
+    const char *value = std::getenv("THREAD_PLACEMENT");
+    return parse(value != nullptr ? value : "cores");
+  }
+
+  static Placement parse(std::string const &value)
+  {
+    Placement p;
+    if (value == "none")
+      {
+        p.policy = NONE;
+      }
+    else if (value == "compact")
+      {
+        p.policy = COMPACT;
+      }
+    else if (value == "scatter")
+      {
+        p.policy = SCATTER;
+      }
+    else if (value == "cores")
+      {
+        p.policy = CORES;
+      }
+    else
+      {
+        // comma separated CPUs and ranges, e.g. 0,2,8-11
+        p.policy = LIST;
+        std::stringstream items(value);
+        std::string item;
+        while (std::getline(items, item, ','))
+          {
+            int first, last;
+            char dash;
+            std::stringstream range(item);
+            if (!(range >> first))
+              {
+                continue;
+              }
+            last = (range >> dash >> last) ? last : first;
+            for (int cpu=first; cpu<=last; ++cpu)
+              {
+                p.cpus.push_back(cpu);
+              }
+          }
+        if (p.cpus.empty())
+          {
+            p.policy = CORES;
+          }
+      }
+    if (p.policy != LIST && p.policy != NONE)
+      {
+        p.cpus = topology_order(p.policy);
+      }
+    return p;
+  }
+
+  // CPU for worker i, or -1 if the worker is not pinned
+  int cpu_for(int worker) const
+  {
+    if (policy == NONE || cpus.empty())
+      {
+        return -1;
+      }
+    return cpus[worker % cpus.size()];
+  }
+
+  Policy policy = CORES;
+  std::vector<int> cpus;
+
+private:
+  static int read_id(int cpu, const char *name, int fallback)
+  {
+    std::ifstream f("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/" + name);
+    int id;
+    return (f >> id) ? id : fallback;
+  }
+
+  // Usable CPUs sorted for the policy, using the sysfs topology
+  static std::vector<int> topology_order(Policy policy)
+  {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    sched_getaffinity(0, sizeof(set), &set);
+
+    // (package, core, cpu) of every CPU we may run on
+    std::vector<std::tuple<int, int, int>> cpus;
+    for (int cpu=0; cpu<CPU_SETSIZE; ++cpu)
+      {
+        if (CPU_ISSET(cpu, &set))
+          {
+            cpus.emplace_back(read_id(cpu, "physical_package_id", 0), read_id(cpu, "core_id", cpu), cpu);
+          }
+      }
+    std::sort(cpus.begin(), cpus.end());
+
+    // rank of each CPU among its core's SMT siblings, and of its core in the package
+    std::vector<std::tuple<int, int, int, int>> ranked;  // (smt, core rank, package, cpu)
+    int smt = 0, core_rank = -1;
+    for (size_t i=0; i<cpus.size(); ++i)
+      {
+        int package = std::get<0>(cpus[i]), core = std::get<1>(cpus[i]);
+        bool same_package = i > 0 && std::get<0>(cpus[i - 1]) == package;
+        bool same_core = same_package && std::get<1>(cpus[i - 1]) == core;
+        smt = same_core ? smt + 1 : 0;
+        core_rank = same_core ? core_rank : (same_package ? core_rank + 1 : 0);
+        ranked.emplace_back(smt, core_rank, package, std::get<2>(cpus[i]));
+      }
+
+    std::vector<int> order;
+    if (policy == COMPACT)
+      {
+        for (auto const &c : cpus)
+          {
+            order.push_back(std::get<2>(c));
+          }
+        return order;
+      }
+
+    std::sort(ranked.begin(), ranked.end());
+    for (auto const &r : ranked)
+      {
+        if (policy == SCATTER || std::get<0>(r) == 0)
+          {
+            order.push_back(std::get<3>(r));
+          }
+      }
+    if (policy == CORES)
+      {
+        // cores in package order, one after the other, then their second
+        // hardware threads in the same order, and so on
+        std::vector<std::tuple<int, int, int, int>> by_package;  // (smt, package, core rank, cpu)
+        for (auto const &r : ranked)
+          {
+            by_package.emplace_back(std::get<0>(r), std::get<2>(r), std::get<1>(r), std::get<3>(r));
+          }
+        std::sort(by_package.begin(), by_package.end());
+        order.clear();
+        for (auto const &c : by_package)
+          {
+            order.push_back(std::get<3>(c));
+          }
+      }
+    return order;
+  }
+};
+
+// Number of CPUs the process may run on
+inline int available_cpus()
+{
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  sched_getaffinity(0, sizeof(set), &set);
+  return CPU_COUNT(&set);
+}
+
+// Pins the calling thread to one CPU; returns false if that failed
+inline bool pin_to_cpu(int cpu)
+{
+  if (cpu < 0)
+    {
+      return false;
+    }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+class ThreadPool
+{
+public:
+  explicit ThreadPool(int threads, Placement const &placement = Placement::from_env())
+    : threads(threads),
+      // busy-waiting only pays off when every waiter has a CPU of its own
+      spins(threads < available_cpus() ? 4096 : 0),
+      barrier_(threads, spins), remaining(0), epoch(0), stopping(false)
+  {
+    // with no workers, wait() would never see the tasks finish
+    if (threads < 1)
+      {
+        throw std::invalid_argument("ThreadPool needs at least one thread");
+      }
+    for (int i=0; i<threads; ++i)
+      {
+        workers.emplace_back(&ThreadPool::worker, this, i, placement.cpu_for(i));
+      }
+  }
+
+  ~ThreadPool()
+  {
+    wait();
+    stopping = true;  // published by the epoch increment in start()
+    start([](int) {});
+    for (auto &th : workers)
+      {
+        th.join();
+      }
+  }
+
+  ThreadPool(ThreadPool const &) = delete;
+  ThreadPool &operator=(ThreadPool const &) = delete;
+
+  int size() const
+  {
+    return threads;
+  }
+
+  // Barrier shared by all workers, for use inside a task
+  Barrier &barrier()
+  {
+    return barrier_;
+  }
+
+  // Starts task(i) on every worker i and returns immediately (after the
+  // previous task, if any, has finished)
+  void start(std::function<void(int)> task)
+  {
+    wait();
+    this->task = std::move(task);
+    remaining.store(threads, std::memory_order_relaxed);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      epoch.fetch_add(1, std::memory_order_release);
+    }
+    wake.notify_all();
+  }
+
+  // Waits until every worker has finished the current task
+  void wait()
+  {
+    spin_until([&] { return remaining.load(std::memory_order_acquire) == 0; }, spins);
+  }
+
+  // Fork-join: runs task(i) on every worker i and waits for all of them
+  void run(std::function<void(int)> task)
+  {
+    start(std::move(task));
+    wait();
+  }
+
+private:
+  void worker(int index, int cpu)
+  {
+    pin_to_cpu(cpu);
+    unsigned seen = 0;
+    for (;;)
+      {
+        // spin briefly for low fork latency, then yield (other workers may
+        // share this CPU), then sleep until the next task
+        for (int spin=0; epoch.load(std::memory_order_acquire) == seen; ++spin)
+          {
+            if (spin < spins)
+              {
+                cpu_relax();
+              }
+            else if (spin < (1 << 16))
+              {
+                std::this_thread::yield();
+              }
+            else
+              {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return epoch.load(std::memory_order_acquire) != seen; });
+              }
+          }
+        seen = epoch.load(std::memory_order_acquire);
+        if (stopping)
+          {
+            remaining.fetch_sub(1, std::memory_order_acq_rel);
+            return;
+          }
+        task(index);
+        remaining.fetch_sub(1, std::memory_order_acq_rel);
+      }
+  }
+
+  const int threads;
+  const int spins;
+  std::vector<std::thread> workers;
+  std::function<void(int)> task;
+  Barrier barrier_;
+  alignas(64) std::atomic<int> remaining;
+  alignas(64) std::atomic<unsigned> epoch;
+  std::atomic<bool> stopping;
+  std::mutex mutex;
+  std::condition_variable wake;
+};
+
+#endif // THREAD_POOL_HPP
@@ -0,0 +1,103 @@
+/* Local tuning file
+ * Autotuning modes store the best settings they found for a kernel and a
+ * problem shape, and the programs load them again at startup. Entries are
+ * keyed by the CPU model and core count, so one file can be shared by hosts
+ * of different generations.
+ *
+ * The file (tuning.txt, or $PARALLEL_TUNING_FILE) has one entry per line:
+ *     <host> <kernel> <shape> name=value name=value ...
+*/
+
+#ifndef TUNING_H
+#define TUNING_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TUNING_FILE "tuning.txt"
+#define TUNING_LINE 512
+
+static const char *tuning_path(void) {
+    const char *path = getenv("PARALLEL_TUNING_FILE");
+    return (path != NULL && path[0] != '\0') ? path : TUNING_FILE;
+}
+
+/* Identifies this machine as <cpu model>/<online cores>, without spaces */
+static void tuning_host(char *host, size_t size) {
+    char line[TUNING_LINE], model[TUNING_LINE] = "unknown";
+    FILE *f = fopen("/proc/cpuinfo", "r");
+    if (f != NULL) {
+        while (fgets(line, sizeof(line), f) != NULL) {
+            char *colon = strchr(line, ':');
+            if (strncmp(line, "model name", 10) == 0 && colon != NULL) {
+                snprintf(model, sizeof(model), "%s", colon + 2);
+                model[strcspn(model, "\n")] = '\0';
+                break;
+            }
+        }
+        fclose(f);
+    }
+    snprintf(host, size, "%s/%ld", model, sysconf(_SC_NPROCESSORS_ONLN));
+    for (char *c = host; *c != '\0'; c++) {
+        if (*c == ' ' || *c == '\t') *c = '_';
+    }
+}
+
+/* Finds the entry for kernel and shape on this host and copies its
+ * name=value settings into params. Returns 1 if an entry was found. */
+static int tuning_load(const char *kernel, const char *shape, char *params, size_t size) {
+    char host[TUNING_LINE], line[TUNING_LINE], prefix[3 * TUNING_LINE];
+    FILE *f = fopen(tuning_path(), "r");
+    if (f == NULL) return 0;
+
+    tuning_host(host, sizeof(host));
+    snprintf(prefix, sizeof(prefix), "%s %s %s ", host, kernel, shape);
+    int found = 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (strncmp(line, prefix, strlen(prefix)) == 0) {
+            snprintf(params, size, "%s", line + strlen(prefix));
+            params[strcspn(params, "\n")] = '\0';
+            found = 1; // keep going, the last entry wins
+        }
+    }
+    fclose(f);
+    return found;
+}
+
+/* Returns the value of name in a name=value list, or fallback */
+static int tuning_get(const char *params, const char *name, int fallback) {
+    size_t len = strlen(name);
+    for (const char *p = params; p != NULL && *p != '\0'; p = strchr(p, ' ')) {
+        while (*p == ' ') p++;
+        if (strncmp(p, name, len) == 0 && p[len] == '=') {
+            return atoi(p + len + 1);
+        }
+    }
+    return fallback;
+}
+
+/* Replaces (or adds) the entry for kernel and shape on this host */
+static int tuning_store(const char *kernel, const char *shape, const char *params) {
+    char host[TUNING_LINE], line[TUNING_LINE], prefix[3 * TUNING_LINE], tmp_path[TUNING_LINE];
+    const char *path = tuning_path();
+    tuning_host(host, sizeof(host));
+    snprintf(prefix, sizeof(prefix), "%s %s %s ", host, kernel, shape);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    FILE *out = fopen(tmp_path, "w");
+    if (out == NULL) return -1;
+    FILE *in = fopen(path, "r");
+    if (in != NULL) {
+        while (fgets(line, sizeof(line), in) != NULL) {
+            if (strncmp(line, prefix, strlen(prefix)) != 0) fputs(line, out);
+        }
+        fclose(in);
+    }
+    fprintf(out, "%s%s\n", prefix, params);
+    fclose(out);
+    return rename(tmp_path, path);
+}
+
+#endif /* TUNING_H */
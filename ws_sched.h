@@ -0,0 +1,338 @@
+/* Work-stealing task scheduler
+ * Every worker owns a Chase-Lev deque: it pushes and pops tasks at the
+ * bottom, and idle workers steal from the top of a random victim's deque,
+ * so load balances itself whatever the cost of each task. The thread that
+ * calls ws_start() is worker 0 and takes part in the work while it waits.
+ *
+ * ws_parallel_for() uses lazy binary splitting: a worker runs its range
+ * grain iterations at a time and, whenever its own deque is empty (nobody
+ * has work to steal from it), pushes the upper half of what is left. Ranges
+ * are split only as far as idle workers actually ask for, so irregular
+ * iterations (triangular loops, sparse tiles) need no chunk size tuning.
+ * ws_spawn() and ws_sync() run arbitrary tasks in a group and wait for them;
+ * the argument must stay valid until ws_sync() returns. A full deque runs
+ * the new task inline.
+ *
+ * Calls from a thread that is not a worker, or before ws_start(), run the
+ * work inline. Idle workers spin (unless there are more workers than CPUs),
+ * then yield, then sleep until a task is pushed. The state is per
+ * translation unit. Programs switch to it with SCHEDULER=ws (ws_requested()).
+ *
+ * Usable from C and C++ (GCC builtins for atomics, pthreads for the workers);
+ * C++ also gets ws_parallel_for(begin, end, grain, lambda).
+*/
+
+#ifndef WS_SCHED_H
+#define WS_SCHED_H
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define WS_DEQUE 4096      /* tasks per deque, a power of two */
+#define WS_SPINS 4096      /* idle spins before yielding */
+#define WS_YIELDS 64       /* idle yields before sleeping */
+#define WS_SPLITS 32       /* default grain: a range splits into this many pieces per worker */
+
+typedef void (*ws_task_fn)(void *arg);
+typedef void (*ws_range_fn)(long begin, long end, void *arg);
+
+/* Tasks spawned into a group; ws_sync() waits until all of them have run */
+typedef struct {
+    long pending;
+} ws_group;
+
+#define WS_GROUP_INIT {0}
+
+typedef struct ws_task {
+    ws_task_fn fn;          /* a spawned task, or */
+    ws_range_fn body;       /* the remaining part of a parallel_for range */
+    void *arg;
+    long begin, end, grain;
+    ws_group *group;
+} ws_task;
+
+typedef struct {
+    long top __attribute__((aligned(64)));    /* next task to steal */
+    long bottom __attribute__((aligned(64))); /* next free slot, owner only */
+    ws_task *tasks[WS_DEQUE];
+    unsigned seed;
+    pthread_t thread;
+} ws_worker;
+
+static struct {
+    int threads;
+    int spins;
+    int running;
+    int sleeping;
+    ws_worker *workers;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+} ws_state = {0, 0, 0, 0, NULL, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER};
+
+static __thread int ws_self = -1;
+
+static inline void ws_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#else
+    sched_yield();
+#endif
+}
+
+/* Whether SCHEDULER=ws asks a program to run on this scheduler */
+static inline int ws_requested(void) {
+    const char *scheduler = getenv("SCHEDULER");
+    return scheduler != NULL && strcmp(scheduler, "ws") == 0;
+}
+
+static inline int ws_threads(void) {
+    return ws_state.threads;
+}
+
+/* Chase-Lev deque, with the C11 orderings of Le et al., "Correct and
+ * efficient work-stealing for weak memory models" (PPoPP 2013) */
+static inline int ws_push(ws_worker *w, ws_task *t) {
+    long b = __atomic_load_n(&w->bottom, __ATOMIC_RELAXED);
+    long top = __atomic_load_n(&w->top, __ATOMIC_ACQUIRE);
+    if (b - top >= WS_DEQUE) return 0;
+    __atomic_store_n(&w->tasks[b & (WS_DEQUE - 1)], t, __ATOMIC_RELAXED);
+    __atomic_store_n(&w->bottom, b + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+static inline ws_task *ws_pop(ws_worker *w) {
+    long b = __atomic_load_n(&w->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&w->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    long top = __atomic_load_n(&w->top, __ATOMIC_RELAXED);
+    ws_task *t = NULL;
+    if (top <= b) {
+        t = __atomic_load_n(&w->tasks[b & (WS_DEQUE - 1)], __ATOMIC_RELAXED);
+        if (top == b) {
+            // Last task: race the thieves for it
+            if (!__atomic_compare_exchange_n(&w->top, &top, top + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+                t = NULL;
+            }
+            __atomic_store_n(&w->bottom, b + 1, __ATOMIC_RELAXED);
+        }
+    } else {
+        __atomic_store_n(&w->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+    return t;
+}
+
+static inline ws_task *ws_steal(ws_worker *w) {
+    long top = __atomic_load_n(&w->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    long b = __atomic_load_n(&w->bottom, __ATOMIC_ACQUIRE);
+    if (top >= b) return NULL;
+    ws_task *t = __atomic_load_n(&w->tasks[top & (WS_DEQUE - 1)], __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&w->top, &top, top + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        return NULL;
+    }
+    return t;
+}
+
+static inline int ws_empty(ws_worker *w) {
+    return __atomic_load_n(&w->top, __ATOMIC_RELAXED) >= __atomic_load_n(&w->bottom, __ATOMIC_RELAXED);
+}
+
+/* Own deque first, then one pass over the others from a random victim */
+static inline ws_task *ws_find(int self) {
+    ws_worker *w = &ws_state.workers[self];
+    ws_task *t = ws_pop(w);
+    if (t != NULL || ws_state.threads == 1) return t;
+    w->seed = w->seed * 1103515245u + 12345u;
+    int first = (int)((w->seed >> 16) % (unsigned)(ws_state.threads - 1));
+    for (int i = 0; i < ws_state.threads - 1 && t == NULL; i++) {
+        int victim = (self + 1 + (first + i) % (ws_state.threads - 1)) % ws_state.threads;
+        t = ws_steal(&ws_state.workers[victim]);
+    }
+    return t;
+}
+
+static inline void ws_run(ws_task *t);
+
+/* Queues a task on the calling worker and wakes a sleeping worker for it */
+static inline void ws_submit(ws_task *t) {
+    __atomic_add_fetch(&t->group->pending, 1, __ATOMIC_RELAXED);
+    if (!ws_push(&ws_state.workers[ws_self], t)) {
+        ws_run(t);
+        return;
+    }
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ws_state.sleeping, __ATOMIC_RELAXED) > 0) {
+        pthread_mutex_lock(&ws_state.lock);
+        pthread_cond_signal(&ws_state.wake);
+        pthread_mutex_unlock(&ws_state.lock);
+    }
+}
+
+static inline ws_task *ws_new_task(ws_group *g) {
+    ws_task *t = (ws_task *)calloc(1, sizeof(ws_task));
+    t->group = g;
+    return t;
+}
+
+/* Lazy binary splitting: offer half of the rest whenever our deque is empty */
+static inline void ws_run_range(ws_range_fn body, void *arg, long begin, long end, long grain, ws_group *g) {
+    ws_worker *w = &ws_state.workers[ws_self];
+    while (end - begin > grain) {
+        if (ws_state.threads > 1 && ws_empty(w)) {
+            long middle = begin + (end - begin) / 2;
+            ws_task *t = ws_new_task(g);
+            t->body = body;
+            t->arg = arg;
+            t->begin = middle;
+            t->end = end;
+            t->grain = grain;
+            ws_submit(t);
+            end = middle;
+        } else {
+            body(begin, begin + grain, arg);
+            begin += grain;
+        }
+    }
+    if (begin < end) body(begin, end, arg);
+}
+
+static inline void ws_run(ws_task *t) {
+    ws_group *g = t->group;
+    if (t->body != NULL) {
+        ws_run_range(t->body, t->arg, t->begin, t->end, t->grain, g);
+    } else {
+        t->fn(t->arg);
+    }
+    free(t);
+    __atomic_sub_fetch(&g->pending, 1, __ATOMIC_RELEASE);
+}
+
+/* Worker 1..threads-1: run tasks, then spin, yield and sleep when idle */
+static inline void *ws_worker_main(void *index) {
+    ws_self = (int)(long)index;
+    long idle = 0;
+    while (__atomic_load_n(&ws_state.running, __ATOMIC_ACQUIRE)) {
+        ws_task *t = ws_find(ws_self);
+        if (t != NULL) {
+            ws_run(t);
+            idle = 0;
+        } else if (idle < ws_state.spins) {
+            ws_relax();
+            idle++;
+        } else if (idle < ws_state.spins + WS_YIELDS) {
+            sched_yield();
+            idle++;
+        } else {
+            // Publish that we sleep, then look once more: a push either sees
+            // us sleeping or is seen by this check
+            pthread_mutex_lock(&ws_state.lock);
+            __atomic_add_fetch(&ws_state.sleeping, 1, __ATOMIC_SEQ_CST);
+            int work = 0;
+            for (int i = 0; i < ws_state.threads && !work; i++) work = !ws_empty(&ws_state.workers[i]);
+            if (!work && __atomic_load_n(&ws_state.running, __ATOMIC_ACQUIRE)) {
+                pthread_cond_wait(&ws_state.wake, &ws_state.lock);
+            }
+            __atomic_sub_fetch(&ws_state.sleeping, 1, __ATOMIC_RELAXED);
+            pthread_mutex_unlock(&ws_state.lock);
+            idle = 0;
+        }
+    }
+    return NULL;
+}
+
+/* Starts `threads` workers (0 = one per online CPU), the caller being worker 0 */
+static inline int ws_start(int threads) {
+    if (ws_state.running) return 0;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1) threads = (cpus > 0) ? (int)cpus : 1;
+    ws_state.threads = threads;
+    ws_state.spins = (threads >= cpus) ? 0 : WS_SPINS;
+    ws_state.sleeping = 0;
+    ws_state.workers = (ws_worker *)aligned_alloc(64, threads * sizeof(ws_worker));
+    memset(ws_state.workers, 0, threads * sizeof(ws_worker));
+    for (int i = 0; i < threads; i++) ws_state.workers[i].seed = 2654435761u * (i + 1);
+    ws_self = 0;
+    __atomic_store_n(&ws_state.running, 1, __ATOMIC_RELEASE);
+    for (int i = 1; i < threads; i++) {
+        if (pthread_create(&ws_state.workers[i].thread, NULL, ws_worker_main, (void *)(long)i) != 0) {
+            // Keep the workers we have; thieves only look at started ones
+            ws_state.threads = i;
+            break;
+        }
+    }
+    return 0;
+}
+
+static inline void ws_stop(void) {
+    if (!__atomic_load_n(&ws_state.running, __ATOMIC_ACQUIRE)) return;
+    pthread_mutex_lock(&ws_state.lock);
+    __atomic_store_n(&ws_state.running, 0, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&ws_state.wake);
+    pthread_mutex_unlock(&ws_state.lock);
+    for (int i = 1; i < ws_state.threads; i++) pthread_join(ws_state.workers[i].thread, NULL);
+    free(ws_state.workers);
+    ws_state.workers = NULL;
+    ws_state.threads = 0;
+    ws_self = -1;
+}
+
+static inline int ws_active(void) {
+    return ws_self >= 0 && __atomic_load_n(&ws_state.running, __ATOMIC_ACQUIRE);
+}
+
+/* Runs fn(arg) as a task of group g */
+static inline void ws_spawn(ws_group *g, ws_task_fn fn, void *arg) {
+    if (!ws_active()) {
+        fn(arg);
+        return;
+    }
+    ws_task *t = ws_new_task(g);
+    t->fn = fn;
+    t->arg = arg;
+    ws_submit(t);
+}
+
+/* Waits for the tasks of g, running our own and stolen tasks meanwhile */
+static inline void ws_sync(ws_group *g) {
+    long idle = 0;
+    while (__atomic_load_n(&g->pending, __ATOMIC_ACQUIRE) > 0) {
+        ws_task *t = ws_find(ws_self);
+        if (t != NULL) {
+            ws_run(t);
+            idle = 0;
+        } else if (idle++ < ws_state.spins) {
+            ws_relax();
+        } else {
+            sched_yield();
+        }
+    }
+}
+
+/* Calls body(b, e, arg) on pieces [b, e) covering [begin, end); grain is the
+ * smallest piece (0 picks one from the range and the number of workers) */
+static inline void ws_parallel_for(long begin, long end, long grain, ws_range_fn body, void *arg) {
+    if (end <= begin) return;
+    if (!ws_active()) {
+        body(begin, end, arg);
+        return;
+    }
+    if (grain < 1) grain = (end - begin) / ((long)ws_state.threads * WS_SPLITS);
+    if (grain < 1) grain = 1;
+    ws_group g = WS_GROUP_INIT;
+    ws_run_range(body, arg, begin, end, grain, &g);
+    ws_sync(&g);
+}
+
+#ifdef __cplusplus
+template <typename Body>
+void ws_parallel_for(long begin, long end, long grain, Body body)
+{
+  ws_parallel_for(begin, end, grain,
+                  [](long b, long e, void *arg) { (*static_cast<Body *>(arg))(b, e); }, &body);
+}
+#endif
+
+#endif /* WS_SCHED_H */